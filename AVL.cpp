@@ -1,21 +1,39 @@
 #include "AVL.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
-#include <queue>
+#include <sstream>
 
-#include "json.hpp"
+#include "ForkJoinPool.h"
+#include "JSONReader.h"
+#include "JSONWriter.h"
+#include "MappedAVL.h"
+#include "Trace.h"
+#include "TreePartition.h"
 
 
 AVLNode::AVLNode(int key) :
+	height(0),
+	balance_factor(0),
+	subtree_size(1),
 	key_(key),
-	parent_(std::weak_ptr<AVLNode>()),
+	change_(0),
+	parent_(nullptr),
 	left_(nullptr),
 	right_(nullptr) {}
 
-AVLNode::AVLNode(int key, std::weak_ptr<AVLNode> parent) :
+AVLNode::AVLNode(int key, AVLNode* parent) :
+	height(0),
+	balance_factor(0),
+	subtree_size(1),
 	key_(key),
+	change_(0),
 	parent_(parent),
 	left_(nullptr),
 	right_(nullptr) {}
@@ -32,7 +50,7 @@ bool AVLNode::HasRightChild() const {
 	return right_ != nullptr;
 }
 
-void AVLNode::DeleteChild(std::shared_ptr<AVLNode> v) {
+void AVLNode::DeleteChild(AVLNode* v) {
 	if (left_ == v) {
 		left_ = nullptr;
 	} else if (right_ == v) {
@@ -43,7 +61,7 @@ void AVLNode::DeleteChild(std::shared_ptr<AVLNode> v) {
 	}
 }
 
-void AVLNode::ReplaceChild(std::shared_ptr<AVLNode> v, std::shared_ptr<AVLNode> u) {
+void AVLNode::ReplaceChild(AVLNode* v, AVLNode* u) {
 	if (left_ == u || right_ == u) {
 		std::cerr << "AVLNode::ReplaceChild Error: child passed as replacement\n";
 	}
@@ -59,50 +77,86 @@ void AVLNode::ReplaceChild(std::shared_ptr<AVLNode> v, std::shared_ptr<AVLNode>
 	}
 }
 
-AVL::AVL() : root_(nullptr), size_(0) {}
+AVL::AVL() :
+	size_(0),
+	pool_(std::make_shared< NodePool<AVLNode> >()) {}
+
+// the moved-from tree keeps sharing the pool so it stays usable
+AVL::AVL(AVL&& other) :
+	size_(other.size_),
+	pool_(other.pool_),
+	changes_(std::move(other.changes_)) {
+	root_ = other.root_;
+	other.root_ = nullptr;
+	other.size_ = 0;
+}
+
+AVL& AVL::operator=(AVL&& other) {
+	if (this != &other) {
+		pool_ = other.pool_;
+		root_ = other.root_;
+		size_ = other.size_;
+		// whoever follows this tree's deltas has not seen other's nodes
+		changes_ = std::move(other.changes_);
+		changes_.Reset();
+		other.root_ = nullptr;
+		other.size_ = 0;
+	}
+	return *this;
+}
 
 void AVL::Insert(int key) {
+	AVL_TRACE_EVENT(Insert, key, 0);
 	if (root_ == nullptr) {
-		root_ = std::make_shared<AVLNode>(key);
+		root_ = pool_->Allocate(key);
+		changes_.Created(root_);
 		size_++;
 		return;
 	}
-	std::shared_ptr<AVLNode> currentNode = root_, lastNode = nullptr;
+	AVLNode *currentNode = root_, *lastNode = nullptr;
 	while (currentNode != nullptr) {
 		lastNode = currentNode;
 		currentNode = (key < currentNode->key_) ?
 			currentNode->left_ : currentNode->right_;
 	}
+	AVLNode* node = pool_->Allocate(key, lastNode);
 	if (key < lastNode->key_) {
-		lastNode->left_ = std::make_shared<AVLNode>(key, lastNode);
+		lastNode->left_ = node;
 	} else {
-		lastNode->right_ = std::make_shared<AVLNode>(key, lastNode);
+		lastNode->right_ = node;
 	}
+	changes_.Created(node);
+	changes_.Modified(lastNode);
 	size_++;
 
-    UpdateHeight(root_); //updating the height of root 
- 
+	// only the path from the new leaf back up to the root can change height
+	UpdateAncestors(lastNode);
 }
 
 bool AVL::Delete(int key) {
-	std::shared_ptr<AVLNode> currentNode = root_;
+	AVLNode* currentNode = root_;
 	while (currentNode != nullptr) {
 		if (currentNode->key_ == key) {
-			if (currentNode->IsLeaf()) {
-				DeleteLeaf(currentNode);
-			} else if (currentNode->left_ == nullptr) {
-				assert(currentNode->right_ != nullptr);
-				std::shared_ptr<AVLNode> parent = currentNode->parent_.lock();
-				parent->ReplaceChild(currentNode, currentNode->right_);
-				size_--; assert(size_ >= 0);
-			} else if (currentNode->right_ == nullptr) {
-				assert(currentNode->left_ != nullptr);
-				std::shared_ptr<AVLNode> parent = currentNode->parent_.lock();
-				parent->ReplaceChild(currentNode, currentNode->left_);
+			AVL_TRACE_EVENT(Delete, key, 0);
+			if (currentNode->left_ != nullptr && currentNode->right_ != nullptr) {
+				// take over the in-order successor's key, the successor node
+				// has no left child and is the one that gets unlinked
+				AVLNode* successor = ExtractMin(currentNode->right_);
+				changes_.KeyMoved(successor, currentNode);
+				// their entries name currentNode by its key
+				changes_.Modified(currentNode->parent_);
+				changes_.Modified(currentNode->left_);
+				changes_.Modified(currentNode->right_);
+				currentNode->key_ = successor->key_;
+				pool_->Free(successor);
 				size_--; assert(size_ >= 0);
 			} else {
-				currentNode->key_ = DeleteMin(currentNode);
+				Unlink(currentNode);
+				changes_.Removed(currentNode);
+				pool_->Free(currentNode);
+				size_--; assert(size_ >= 0);
 			}
+			return true;
 		}
 		currentNode = (key < currentNode->key_) ?
 			currentNode->left_ : currentNode->right_;
@@ -111,57 +165,532 @@ bool AVL::Delete(int key) {
 }
 
 int AVL::DeleteMin() {
-	return DeleteMin(root_);
+	int result = DeleteMin(root_);
+	AVL_TRACE_EVENT(DeleteMin, result, 0);
+	return result;
 }
 
+int AVL::DeleteMin(AVLNode* currentNode) {
+	AVLNode* lastNode = ExtractMin(currentNode);
+	int result = lastNode->key_;
+	changes_.Removed(lastNode);
+	pool_->Free(lastNode);
+	size_--; assert(size_ >= 0);
+	return result;
+}
+
+void AVL::ClearForBuild(size_t n) {
+	changes_.Reset();
+	ResetPool();
+	pool_->Reserve(n);
+}
 
-void AVL::DeleteLeaf(std::shared_ptr<AVLNode> currentNode) {
-	std::shared_ptr<AVLNode> parent = currentNode->parent_.lock();
-	if (parent == nullptr) {
-		// Delete root
-		root_ = nullptr;
-		size_--; assert(size_ == 0);
+void AVL::ResetPool() {
+	if (pool_.use_count() == 1) {
+		pool_->Clear();
 	} else {
-		if (parent->right_ == currentNode) {
-			parent->right_ = nullptr;
-		} else if (parent->left_ == currentNode) {
-			parent->left_ = nullptr;
+		pool_ = std::make_shared< NodePool<AVLNode> >();
+	}
+}
+
+std::pair<AVL, AVL> AVL::Split(int key) {
+	// each half allocates from a pool of its own, so the halves can be
+	// updated from different threads: the left half takes this tree's
+	// pool, the right one keeps its slabs alive
+	AVL left, right;
+	changes_.Reset();
+	left.changes_.Reset();
+	right.changes_.Reset();
+	right.pool_->Keep(*pool_);
+	left.pool_ = pool_;
+	pool_ = std::make_shared< NodePool<AVLNode> >();
+	std::pair<AVLNode*, AVLNode*> halves = SplitNodes(root_, key, nullptr);
+	root_ = nullptr;
+	size_ = 0;
+	left.root_ = halves.first;
+	left.size_ = Size(halves.first);
+	right.root_ = halves.second;
+	right.size_ = Size(halves.second);
+	return std::make_pair(std::move(left), std::move(right));
+}
+
+AVL AVL::Join(AVL&& left, int pivot, AVL&& right) {
+	AVL result;
+	left.changes_.Reset();
+	right.changes_.Reset();
+	result.changes_.Reset();
+	result.pool_ = MergePools(left.pool_, right.pool_);
+	AVLNode* node = result.pool_->Allocate(pivot);
+	result.root_ = result.JoinNodes(left.root_, node, right.root_);
+	result.size_ = Size(result.root_);
+	left.root_ = right.root_ = nullptr;
+	left.size_ = right.size_ = 0;
+	return result;
+}
+
+AVL AVL::Join(AVL&& left, AVL&& right) {
+	if (right.empty()) {
+		return std::move(left);
+	}
+	if (left.empty()) {
+		return std::move(right);
+	}
+	int pivot = right.DeleteMin();
+	return Join(std::move(left), pivot, std::move(right));
+}
+
+std::shared_ptr< NodePool<AVLNode> > AVL::MergePools(
+		const std::shared_ptr< NodePool<AVLNode> >& a,
+		const std::shared_ptr< NodePool<AVLNode> >& b) {
+	a->Adopt(*b);
+	return a;
+}
+
+std::pair<AVLNode*, AVLNode*> AVL::SplitNodes(AVLNode* root, int key, AVLNode** found) {
+	// top-down: every node on the search path goes to one side together
+	// with its subtree on that side, the pieces are joined bottom-up
+	std::vector< std::pair<AVLNode*, AVLNode*> > leftPieces, rightPieces;
+	AVLNode* currentNode = root;
+	if (found != nullptr) {
+		*found = nullptr;
+	}
+	while (currentNode != nullptr) {
+		AVLNode* next;
+		if (found != nullptr && key == currentNode->key_) {
+			// three-way split: the match is handed back on its own
+			*found = currentNode;
+			leftPieces.push_back(std::make_pair(nullptr, currentNode->left_));
+			rightPieces.push_back(std::make_pair(nullptr, currentNode->right_));
+			next = nullptr;
+		} else if (key <= currentNode->key_) {
+			rightPieces.push_back(std::make_pair(currentNode, currentNode->right_));
+			next = currentNode->left_;
 		} else {
-			std::cerr << "AVL::DeleteLeaf Error: inconsistent state\n";
+			leftPieces.push_back(std::make_pair(currentNode, currentNode->left_));
+			next = currentNode->right_;
 		}
-		size_--; assert(size_ >= 0);
+		currentNode->parent_ = currentNode->left_ = currentNode->right_ = nullptr;
+		currentNode = next;
 	}
+
+	AVLNode* leftRoot = nullptr;
+	for (size_t i = leftPieces.size(); i-- > 0; ) {
+		AVLNode* subtree = leftPieces[i].second;
+		if (subtree != nullptr) {
+			subtree->parent_ = nullptr;
+		}
+		leftRoot = (leftPieces[i].first == nullptr) ? subtree :
+			JoinNodes(subtree, leftPieces[i].first, leftRoot);
+	}
+	AVLNode* rightRoot = nullptr;
+	for (size_t i = rightPieces.size(); i-- > 0; ) {
+		AVLNode* subtree = rightPieces[i].second;
+		if (subtree != nullptr) {
+			subtree->parent_ = nullptr;
+		}
+		rightRoot = (rightPieces[i].first == nullptr) ? subtree :
+			JoinNodes(rightRoot, rightPieces[i].first, subtree);
+	}
+	return std::make_pair(leftRoot, rightRoot);
 }
 
-int AVL::DeleteMin(std::shared_ptr<AVLNode> currentNode) {
-	std::shared_ptr<AVLNode> lastNode = nullptr;
-	while (currentNode != nullptr) {
-		lastNode = currentNode;
-		currentNode = currentNode->left_;
+AVLNode* AVL::JoinNodes(AVLNode* left, AVLNode* pivot, AVLNode* right) {
+	int leftHeight = Height(left), rightHeight = Height(right);
+	pivot->parent_ = nullptr;
+	if (leftHeight <= rightHeight + 1 && rightHeight <= leftHeight + 1) {
+		pivot->left_ = left;
+		pivot->right_ = right;
+		if (left != nullptr) {
+			left->parent_ = pivot;
+		}
+		if (right != nullptr) {
+			right->parent_ = pivot;
+		}
+		FixNode(pivot);
+		return pivot;
 	}
-	int result = lastNode->key_;
-	std::shared_ptr<AVLNode> parent = lastNode->parent_.lock();
-	if (parent == nullptr) {
-		// lastNode is root
-		if (lastNode->right_ != nullptr) {
-			root_ = lastNode->right_;
-			lastNode->right_->parent_.reset();
-		} else {
-			root_ = nullptr;
+	AVLNode* top;
+	AVLNode* parent = nullptr;
+	if (leftHeight > rightHeight) {
+		// hang pivot off the right spine of left where heights line up
+		top = left;
+		AVLNode* currentNode = left;
+		while (Height(currentNode) > rightHeight + 1) {
+			parent = currentNode;
+			currentNode = currentNode->right_;
+		}
+		pivot->left_ = currentNode;
+		pivot->right_ = right;
+		parent->right_ = pivot;
+	} else {
+		top = right;
+		AVLNode* currentNode = right;
+		while (Height(currentNode) > leftHeight + 1) {
+			parent = currentNode;
+			currentNode = currentNode->left_;
+		}
+		pivot->left_ = left;
+		pivot->right_ = currentNode;
+		parent->left_ = pivot;
+	}
+	pivot->parent_ = parent;
+	if (pivot->left_ != nullptr) {
+		pivot->left_->parent_ = pivot;
+	}
+	if (pivot->right_ != nullptr) {
+		pivot->right_->parent_ = pivot;
+	}
+	FixNode(pivot);
+	UpdateAncestors(parent);
+	// a rotation at the top sinks the old root by at most two levels
+	while (top->parent_ != nullptr) {
+		top = top->parent_;
+	}
+	return top;
+}
+
+AVLNode* AVL::JoinNodes(AVLNode* left, AVLNode* right) {
+	if (right == nullptr) {
+		return left;
+	}
+	if (left == nullptr) {
+		return right;
+	}
+	AVLNode* top = (right->left_ == nullptr) ? right->right_ : right;
+	AVLNode* pivot = ExtractMin(right);
+	if (top != nullptr) {
+		while (top->parent_ != nullptr) {
+			top = top->parent_;
+		}
+	}
+	return JoinNodes(left, pivot, top);
+}
+
+AVL AVL::Union(AVL&& a, AVL&& b, ForkJoinPool& pool) {
+	return SetOperation(std::move(a), std::move(b), pool, &AVL::UnionNodes);
+}
+
+AVL AVL::Intersection(AVL&& a, AVL&& b, ForkJoinPool& pool) {
+	return SetOperation(std::move(a), std::move(b), pool, &AVL::IntersectionNodes);
+}
+
+AVL AVL::Difference(AVL&& a, AVL&& b, ForkJoinPool& pool) {
+	return SetOperation(std::move(a), std::move(b), pool, &AVL::DifferenceNodes);
+}
+
+AVL AVL::SetOperation(AVL&& a, AVL&& b, ForkJoinPool& pool,
+		AVLNode* (AVL::*operation)(AVLNode*, AVLNode*, SetContext&, int)) {
+	AVL result;
+	a.changes_.Reset();
+	b.changes_.Reset();
+	result.changes_.Reset();
+	result.pool_ = MergePools(a.pool_, b.pool_);
+	SetContext context;
+	context.forkJoin = &pool;
+	// a few tasks per thread keeps everyone busy without drowning in tiny ones
+	context.maxDepth = 2;
+	for (unsigned threads = context.forkJoin->size(); threads > 1; threads /= 2) {
+		context.maxDepth++;
+	}
+	AVLNode* aRoot = a.root_;
+	AVLNode* bRoot = b.root_;
+	a.root_ = b.root_ = nullptr;
+	a.size_ = b.size_ = 0;
+	result.root_ = (result.*operation)(aRoot, bRoot, context, 0);
+	result.size_ = Size(result.root_);
+	// discarded nodes go back to the pool only now, NodePool is not thread-safe
+	std::vector<AVLNode*> stack(context.discarded);
+	while (!stack.empty()) {
+		AVLNode* node = stack.back();
+		stack.pop_back();
+		if (node->left_ != nullptr) {
+			stack.push_back(node->left_);
+		}
+		if (node->right_ != nullptr) {
+			stack.push_back(node->right_);
 		}
+		result.pool_->Free(node);
+	}
+	return result;
+}
+
+void AVL::Discard(AVLNode* subtree, SetContext& context) {
+	if (subtree != nullptr) {
+		std::lock_guard<std::mutex> lock(context.mutex);
+		context.discarded.push_back(subtree);
+	}
+}
+
+template <class Left, class Right>
+void AVL::ForkJoin(SetContext& context, int depth, size_t work, Left left, Right right) {
+	static const size_t kGrain = 4096;
+	if (depth < context.maxDepth && work >= kGrain) {
+		context.forkJoin->Invoke(left, right);
 	} else {
-		// lastNode under the root
-		if (lastNode->right_ != nullptr) {
-			parent->left_ = lastNode->right_;
-			lastNode->right_->parent_ = parent;
+		left();
+		right();
+	}
+}
+
+AVLNode* AVL::UnionNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth) {
+	if (a == nullptr) {
+		return b;
+	}
+	if (b == nullptr) {
+		return a;
+	}
+	AVLNode* found;
+	std::pair<AVLNode*, AVLNode*> bHalves = SplitNodes(b, a->key_, &found);
+	if (found != nullptr) {
+		Discard(found, context);
+	}
+	AVLNode *aLeft = a->left_, *aRight = a->right_;
+	DetachChildren(a);
+	AVLNode *left, *right;
+	ForkJoin(context, depth, Size(aLeft) + Size(aRight) + Size(bHalves.first) + Size(bHalves.second),
+		[&] { left = UnionNodes(aLeft, bHalves.first, context, depth + 1); },
+		[&] { right = UnionNodes(aRight, bHalves.second, context, depth + 1); });
+	return JoinNodes(left, a, right);
+}
+
+AVLNode* AVL::IntersectionNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth) {
+	if (a == nullptr || b == nullptr) {
+		Discard(a, context);
+		Discard(b, context);
+		return nullptr;
+	}
+	AVLNode* found;
+	std::pair<AVLNode*, AVLNode*> bHalves = SplitNodes(b, a->key_, &found);
+	AVLNode *aLeft = a->left_, *aRight = a->right_;
+	DetachChildren(a);
+	AVLNode *left, *right;
+	ForkJoin(context, depth, Size(aLeft) + Size(aRight) + Size(bHalves.first) + Size(bHalves.second),
+		[&] { left = IntersectionNodes(aLeft, bHalves.first, context, depth + 1); },
+		[&] { right = IntersectionNodes(aRight, bHalves.second, context, depth + 1); });
+	if (found == nullptr) {
+		Discard(a, context);
+		return JoinNodes(left, right);
+	}
+	Discard(found, context);
+	return JoinNodes(left, a, right);
+}
+
+AVLNode* AVL::DifferenceNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth) {
+	if (a == nullptr || b == nullptr) {
+		Discard(b, context);
+		return a;
+	}
+	AVLNode* found;
+	std::pair<AVLNode*, AVLNode*> aHalves = SplitNodes(a, b->key_, &found);
+	if (found != nullptr) {
+		Discard(found, context);
+	}
+	AVLNode *bLeft = b->left_, *bRight = b->right_;
+	DetachChildren(b);
+	Discard(b, context);
+	AVLNode *left, *right;
+	ForkJoin(context, depth, Size(bLeft) + Size(bRight) + Size(aHalves.first) + Size(aHalves.second),
+		[&] { left = DifferenceNodes(aHalves.first, bLeft, context, depth + 1); },
+		[&] { right = DifferenceNodes(aHalves.second, bRight, context, depth + 1); });
+	return JoinNodes(left, right);
+}
+
+void AVL::DetachChildren(AVLNode* node) {
+	if (node->left_ != nullptr) {
+		node->left_->parent_ = nullptr;
+	}
+	if (node->right_ != nullptr) {
+		node->right_->parent_ = nullptr;
+	}
+	node->left_ = node->right_ = nullptr;
+}
+
+AVL::const_iterator AVL::begin() const {
+	return const_iterator(const_iterator::Leftmost(root_), &root_);
+}
+
+AVL::const_iterator AVL::end() const {
+	return const_iterator(nullptr, &root_);
+}
+
+AVL::const_iterator AVL::lower_bound(int key) const {
+	AVLNode *currentNode = root_, *result = nullptr;
+	while (currentNode != nullptr) {
+		if (currentNode->key_ < key) {
+			currentNode = currentNode->right_;
 		} else {
-			parent->left_ = nullptr;
+			result = currentNode;
+			currentNode = currentNode->left_;
 		}
-  }
-	size_--; assert(size_ >= 0);
+	}
+	return const_iterator(result, &root_);
+}
+
+AVL::const_iterator AVL::upper_bound(int key) const {
+	AVLNode *currentNode = root_, *result = nullptr;
+	while (currentNode != nullptr) {
+		if (key < currentNode->key_) {
+			result = currentNode;
+			currentNode = currentNode->left_;
+		} else {
+			currentNode = currentNode->right_;
+		}
+	}
+	return const_iterator(result, &root_);
+}
+
+std::pair<AVL::const_iterator, AVL::const_iterator> AVL::equal_range(int key) const {
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+FrozenAVL AVL::Freeze() const {
+	return FrozenAVL(begin(), size_);
+}
+
+void AVL::Save(const std::string& path, ForkJoinPool& pool) const {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "AVL::Save Error: cannot open " << path << "\n";
+		exit(EXIT_FAILURE);
+	}
+	MappedAVLHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MappedAVL::kMagic, sizeof(header.magic));
+	header.version = MappedAVL::kVersion;
+	header.headerSize = sizeof(header);
+	header.count = size_;
+	// the checksum is only known at the end, the header is written again then
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	SnapshotChecksum checksum;
+	// keys go out a wave of pieces at a time, each piece filled by its own
+	// task at its rank, see TreePartition.h; heights follow the keys in the
+	// file so they are kept until the last wave. The checksum and the
+	// writes stay in order on this thread.
+	TreePartition<AVLNode> partition(root_, size_);
+	std::vector<size_t> ranks(partition.size() + 1, 0);
+	for (size_t i = 0; i < partition.size(); i++) {
+		ranks[i + 1] = ranks[i] + (partition.Whole(i) ? Size(partition.Top(i)) : 1);
+	}
+	std::vector<uint8_t> heights(size_);
+	std::vector<int> keys;
+	size_t wave = 4 * pool.size();
+	for (size_t first = 0; first < partition.size(); first += wave) {
+		size_t last = std::min(partition.size(), first + wave);
+		keys.resize(ranks[last] - ranks[first]);
+		auto work = [&](size_t i) {
+			int* key = keys.data() + (ranks[i] - ranks[first]);
+			uint8_t* height = heights.data() + ranks[i];
+			partition.Visit(i, [&key, &height](const AVLNode* node) {
+				*key++ = node->key_;
+				*height++ = static_cast<uint8_t>(node->height);
+			});
+		};
+		TreePartition<AVLNode>::Fork(pool, first, last, work);
+		checksum.Update(keys.data(), keys.size() * sizeof(int));
+		out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(int));
+	}
+	checksum.Update(heights.data(), heights.size());
+	out.write(reinterpret_cast<const char*>(heights.data()), heights.size());
+	header.checksum = checksum.Value();
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.flush();
+	if (!out) {
+		std::cerr << "AVL::Save Error: writing " << path << " failed\n";
+		exit(EXIT_FAILURE);
+	}
+}
+
+AVL AVL::Load(const std::string& path) {
+	MappedAVL mapped(path);
+	const int* keys = mapped.begin();
+	const uint8_t* heights = mapped.heights();
+	size_t n = mapped.size();
+	AVL result;
+	result.changes_.Reset();
+	result.pool_->Reserve(n);
+	// a node's left child is the tallest of the nodes right before it in
+	// order that are lower than it, and a node's parent is taller than it.
+	// So the right spine of the tree built so far sits on a stack, tallest
+	// at the bottom, and each new node takes what it pops off as its left
+	// subtree; a popped node's subtree is complete and gets checked then.
+	std::vector<AVLNode*> spine;
+	for (size_t i = 0; i < n; i++) {
+		if (i > 0 && keys[i] < keys[i - 1]) {
+			std::cerr << "AVL::Load Error: keys in " << path << " are out of order\n";
+			exit(EXIT_FAILURE);
+		}
+		AVLNode* node = result.pool_->Allocate(keys[i]);
+		node->height = heights[i];
+		AVLNode* popped = nullptr;
+		while (!spine.empty() && spine.back()->height < node->height) {
+			popped = spine.back();
+			spine.pop_back();
+			if (!RestoreNode(popped)) {
+				std::cerr << "AVL::Load Error: " << path << " does not hold an AVL tree\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+		node->left_ = popped;
+		if (popped != nullptr) {
+			popped->parent_ = node;
+		}
+		if (!spine.empty()) {
+			spine.back()->right_ = node;
+			node->parent_ = spine.back();
+		}
+		spine.push_back(node);
+	}
+	if (!spine.empty()) {
+		result.root_ = spine.front();
+	}
+	while (!spine.empty()) {
+		if (!RestoreNode(spine.back())) {
+			std::cerr << "AVL::Load Error: " << path << " does not hold an AVL tree\n";
+			exit(EXIT_FAILURE);
+		}
+		spine.pop_back();
+	}
+	result.size_ = n;
+	return result;
+}
+
+AVL AVL::FromJSON(std::istream& in) {
+	AVL result;
+	JSONReader reader(in);
+	result.changes_.Reset();
+	result.root_ = reader.ReadTree<AVLNode>(*result.pool_, &result.size_);
+	result.RestoreHeights();
+	return result;
+}
+
+AVL AVL::FromJSON(const std::string& document) {
+	AVL result;
+	JSONReader reader(document);
+	result.changes_.Reset();
+	result.root_ = reader.ReadTree<AVLNode>(*result.pool_, &result.size_);
+	result.RestoreHeights();
 	return result;
 }
 
+void AVL::RestoreHeights() {
+	// the same parent-link post-order walk as UpdateHeight
+	AVLNode* node = (root_ != nullptr) ? FirstPostOrder(root_) : nullptr;
+	while (node != nullptr) {
+		node->height = 1 + std::max(Height(node->left_), Height(node->right_));
+		if (!RestoreNode(node)) {
+			std::cerr << "AVL::FromJSON Error: node " << node->key_ << " is out of balance\n";
+			exit(EXIT_FAILURE);
+		}
+		AVLNode* parent = node->parent_;
+		if (parent != nullptr && node == parent->left_ && parent->right_ != nullptr) {
+			node = FirstPostOrder(parent->right_);
+		} else {
+			node = parent;
+		}
+	}
+}
+
 size_t AVL::size() const {
 	return size_;
 }
@@ -170,8 +699,12 @@ bool AVL::empty() const {
 	return size_ == 0;
 }
 
+bool AVL::IsBalanced() const {
+	return CheckSubtree(root_, nullptr) != -2 && Size(root_) == size_;
+}
+
 bool AVL::Find(int key) const {
-	std::shared_ptr<AVLNode> currentNode = root_;
+	AVLNode* currentNode = root_;
 	while (currentNode != nullptr) {
 		if (currentNode->key_ == key) {
 			return true;
@@ -182,100 +715,234 @@ bool AVL::Find(int key) const {
 	return false;
 }
 
-std::string AVL::JSON() const {
-	nlohmann::json result;
-	std::queue< std::shared_ptr<AVLNode> > nodes;
-	if (root_ != nullptr) {
-		result["root"] = root_->key_;
-		nodes.push(root_);
-		while (!nodes.empty()) {
-			auto v = nodes.front();
-			nodes.pop();
-			std::string key = std::to_string(v->key_);
-			if (v->left_ != nullptr) {
-				result[key]["left"] = v->left_->key_;
-				nodes.push(v->left_);
-			}
-			if (v->right_ != nullptr) {
-				result[key]["right"] = v->right_->key_;
-				nodes.push(v->right_);
-			}
-			if (v->parent_.lock() != nullptr) {
-				result[key]["parent"] = v->parent_.lock()->key_;
-			} else {
-				result[key]["root"] = true;
+void AVL::FindMany(const int* keys, size_t count, bool* out) const {
+	// enough descents in flight to cover a miss to memory; a slot whose
+	// lookup finishes is refilled with the next key right away
+	const size_t kInFlight = 16;
+	AVLNode* nodes[kInFlight];
+	size_t lookups[kInFlight];
+	size_t active = 0, next = 0;
+	while (active < kInFlight && next < count) {
+		nodes[active] = root_;
+		lookups[active++] = next++;
+	}
+	while (active > 0) {
+		for (size_t i = 0; i < active; ) {
+			AVLNode* currentNode = nodes[i];
+			int key = keys[lookups[i]];
+			if (currentNode == nullptr || currentNode->key_ == key) {
+				out[lookups[i]] = (currentNode != nullptr);
+				if (next < count) {
+					nodes[i] = root_;
+					lookups[i++] = next++;
+				} else {
+					// swap the last slot in and look at it in this round
+					active--;
+					nodes[i] = nodes[active];
+					lookups[i] = lookups[active];
+				}
+				continue;
 			}
+			currentNode = (key < currentNode->key_) ?
+				currentNode->left_ : currentNode->right_;
+			__builtin_prefetch(currentNode);
+			nodes[i++] = currentNode;
 		}
 	}
-	result["size"] = size_;
-	return result.dump(2) + "\n";
 }
-int AVL :: UpdateHeight (std::shared_ptr<AVLNode> node)
-{
-		//if the node is null ptr the height is -1
-		if(node == nullptr)
-		{	
-			return -1;
+
+size_t AVL::Rank(int key) const {
+	size_t rank = 0;
+	AVLNode* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (key <= currentNode->key_) {
+			currentNode = currentNode->left_;
+		} else {
+			rank += Size(currentNode->left_) + 1;
+			currentNode = currentNode->right_;
 		}
-		if(node -> IsLeaf())
-		{		
-			return 0; 
+	}
+	return rank;
+}
+
+size_t AVL::RankUpper(int key) const {
+	size_t rank = 0;
+	AVLNode* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (key < currentNode->key_) {
+			currentNode = currentNode->left_;
+		} else {
+			rank += Size(currentNode->left_) + 1;
+			currentNode = currentNode->right_;
 		}
-		else
-		{
-			std::cout<<"not a leaf"<<std::endl; 
-			int leftheight = UpdateHeight(node -> left_); // get the height of the left subtree
-			int rightHeight = UpdateHeight(node -> right_); //get the height of right subtree
-			node -> height = 1 + (std::max(leftheight, rightHeight)); 
-			node -> balance_factor = rightHeight - leftheight;
+	}
+	return rank;
+}
 
+int AVL::Select(size_t k) const {
+	if (k >= size_) {
+		std::cerr << "AVL::Select Error: rank out of range\n";
+		exit(EXIT_FAILURE);
+	}
+	AVLNode* currentNode = root_;
+	while (true) {
+		size_t leftSize = Size(currentNode->left_);
+		if (k < leftSize) {
+			currentNode = currentNode->left_;
+		} else if (k == leftSize) {
+			return currentNode->key_;
+		} else {
+			k -= leftSize + 1;
+			currentNode = currentNode->right_;
 		}
-	return node -> height;
+	}
 }
 
+size_t AVL::CountRange(int lo, int hi) const {
+	if (hi < lo) {
+		return 0;
+	}
+	return RankUpper(hi) - Rank(lo);
+}
 
-// void AVL :: rightrotation (std::shared_ptr<AVLNode> node)
-// {
-// 	if(node -> balance_factor < -1) //if the node is left heavy we have to do a right right rotation
-// 	{
-// 		std::shared_ptr<AVLNode> y = node -> left_; 
-// 		std::shared_ptr<AVLNode> y_ = node -> left_-> right_; 
+std::string AVL::JSON(ForkJoinPool& pool) const {
+	std::ostringstream out;
+	WriteJSON(out, false, pool);
+	return out.str();
+}
 
-// 		std::shared_ptr<AVLNode> parent = node -> parent_.lock(); 
+void AVL::WriteJSON(std::ostream& out, bool compact, ForkJoinPool& pool) const {
+	JSONWriter writer(out, compact);
+	writer.WriteTree(root_, size_, pool);
+}
 
-// 		node->left_ = y_; 
-// 		y -> right_ = node; 
-// 		parent -> left_ = y; 
+void AVL::WriteJSON(int fd, bool compact, ForkJoinPool& pool) const {
+	JSONWriter writer(fd, compact);
+	writer.WriteTree(root_, size_, pool);
+}
 
-// 		node -> parent_ = y; 
-// 		y -> parent_ = parent; 
-// 		y_ -> parent_ = node; 
+std::string AVL::JSONDelta() {
+	std::ostringstream out;
+	WriteJSONDelta(out);
+	return out.str();
+}
 
-// 		UpdateHeight(node); 
-// 		//WE HAVE TO FIGURE OUT HOW TO CALL THE LEFT ROTATION FOR A RIGHT LEFT ROATATION
-// 	}
-// }
+void AVL::WriteJSONDelta(std::ostream& out, bool compact) {
+	JSONWriter writer(out, compact);
+	WriteDelta(writer);
+}
 
-// void AVL :: leftrotation (std::shared_ptr<AVLNode> node)
-// {
-// 	if(node -> balance_factor > 1)
-// 	{
-// 		std::shared_ptr<AVLNode> y = node -> right_; 
-// 		std::shared_ptr<AVLNode> y_ = node -> right_ -> left_; 
-// 		std::shared_ptr<AVLNode> parent = node -> parent_.lock(); 
+void AVL::WriteJSONDelta(int fd, bool compact) {
+	JSONWriter writer(fd, compact);
+	WriteDelta(writer);
+}
 
-// 		node -> right_ = y_; 
-// 		y -> left_ = node; 
-// 		parent -> right_ = y; 
+void AVL::WriteDelta(JSONWriter& writer) {
+	std::vector<const AVLNode*> created, modified;
+	std::vector<int> removed, vanished;
+	bool reset;
+	changes_.TakeChanges(&created, &modified, &removed, &vanished, &reset);
+	writer.WriteDelta(root_, size_, reset, created, modified, removed, vanished);
+}
+int AVL::Height(const AVLNode* node) {
+	return (node == nullptr) ? -1 : node->height;
+}
 
-// 		node -> parent_ = y; 
-// 		y -> parent_ = parent; 
-// 		y_ -> parent_ = node; 
+int AVL::CheckSubtree(const AVLNode* node, const AVLNode* parent) {
+	if (node == nullptr) {
+		return -1;
+	}
+	int leftHeight = CheckSubtree(node->left_, node);
+	int rightHeight = CheckSubtree(node->right_, node);
+	if (leftHeight == -2 || rightHeight == -2 || node->parent_ != parent ||
+			node->height != 1 + std::max(leftHeight, rightHeight) ||
+			node->balance_factor != rightHeight - leftHeight ||
+			node->balance_factor < -1 || node->balance_factor > 1 ||
+			node->subtree_size != 1 + Size(node->left_) + Size(node->right_)) {
+		return -2;
+	}
+	return node->height;
+}
 
-// 		UpdateHeight(node); 
-		 		
-// 	}
-// 	// FIGURE OUT HOW TO CALL RIGHT ROTATION FOR A LEFT RIGTH ROTATION 
+void AVL::FixNode(AVLNode* node) {
+	int leftHeight = Height(node->left_);
+	int rightHeight = Height(node->right_);
+	int height = 1 + std::max(leftHeight, rightHeight);
+	if (height != node->height) {
+		AVL_TRACE_EVENT(HeightChange, node->key_, height);
+		node->height = height;
+	}
+	node->balance_factor = rightHeight - leftHeight;
+	node->subtree_size = 1 + Size(node->left_) + Size(node->right_);
+}
+
+bool AVL::RestoreNode(AVLNode* node) {
+	int leftHeight = Height(node->left_);
+	int rightHeight = Height(node->right_);
+	node->balance_factor = rightHeight - leftHeight;
+	node->subtree_size = 1 + Size(node->left_) + Size(node->right_);
+	return node->height == 1 + std::max(leftHeight, rightHeight) &&
+		node->balance_factor >= -1 && node->balance_factor <= 1;
+}
 
-// }
-// //MAYBE CREATE A GET HEIGHT FUNCTION
\ No newline at end of file
+size_t AVL::Size(const AVLNode* node) {
+	return (node == nullptr) ? 0 : node->subtree_size;
+}
+
+void AVL::FixAugment(AVLNode* node) {
+	node->subtree_size = 1 + Size(node->left_) + Size(node->right_);
+}
+
+void AVL::Linked(AVLNode* node) {
+	changes_.Modified(node);
+}
+
+void AVL::Rotated(AVLNode* node, bool left) {
+	if (left) {
+		AVL_TRACE_EVENT(RotateLeft, node->key_, 0);
+	} else {
+		AVL_TRACE_EVENT(RotateRight, node->key_, 0);
+	}
+}
+
+void AVL::rebalance(AVLNode* currentNode) {
+	Rebalance(currentNode);
+}
+
+int AVL :: UpdateHeight (AVLNode* node)
+{
+		//if the node is null ptr the height is -1
+		if(node == nullptr)
+		{	
+			return -1;
+		}
+		// post-order walk over node's subtree that climbs back up through
+		// parent_ instead of recursing, so degenerate trees cannot blow the stack
+		AVLNode* currentNode = FirstPostOrder(node);
+		while(true)
+		{
+			FixNode(currentNode); 
+			if(currentNode == node)
+			{
+				break;
+			}
+			AVLNode* parent = currentNode -> parent_;
+			if(currentNode == parent -> left_ && parent -> right_ != nullptr)
+			{
+				currentNode = FirstPostOrder(parent -> right_);
+			}
+			else
+			{
+				currentNode = parent;
+			}
+		}
+	return node -> height;
+}
+
+AVLNode* AVL::FirstPostOrder(AVLNode* currentNode) {
+	while (!currentNode->IsLeaf()) {
+		currentNode = (currentNode->left_ != nullptr) ?
+			currentNode->left_ : currentNode->right_;
+	}
+	return currentNode;
+}
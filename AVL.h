@@ -12,59 +12,298 @@
 
 */
 
+#ifndef AVL_H
+#define AVL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iosfwd>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "AVLBase.h"
+#include "ChangeLog.h"
+#include "ForkJoinPool.h"
+#include "FrozenAVL.h"
+#include "NodePool.h"
+#include "TreeIterator.h"
 
 class AVL;
+class JSONReader;
+class JSONWriter;
+template <class Node>
+class TreePartition;
 
 class AVLNode {
  public:
  	AVLNode(int key);
- 	AVLNode(int key, std::weak_ptr<AVLNode> parent);
+ 	AVLNode(int key, AVLNode* parent);
  	bool IsLeaf() const;
  	bool IsMissingChild() const;
  	bool HasLeftChild() const;
  	bool HasRightChild() const;
- 	void DeleteChild(std::shared_ptr<AVLNode> v);
- 	void ReplaceChild(std::shared_ptr<AVLNode> v, std::shared_ptr<AVLNode> u);
+ 	void DeleteChild(AVLNode* v);
+ 	void ReplaceChild(AVLNode* v, AVLNode* u);
 	int height;
   	int balance_factor;
+	// number of nodes in the subtree rooted here, lets Split/Join keep
+	// AVL::size_ exact without counting
+	size_t subtree_size;
    
 
 
  private:
   int key_;
-  std::weak_ptr<AVLNode> parent_;
-  std::shared_ptr<AVLNode> left_;
-  std::shared_ptr<AVLNode> right_;
+  // slot in the tree's ChangeLog, see ChangeLog.h
+  uint32_t change_;
+  AVLNode* parent_;
+  AVLNode* left_;
+  AVLNode* right_;
 
   friend AVL;
+  friend AVLBase<AVL, AVLNode>;
+  friend ChangeLog<AVLNode>;
+  friend TreeIterator<AVLNode>;
+  friend JSONWriter;
+  friend JSONReader;
+  friend TreePartition<AVLNode>;
 }; // class AVLNode
 
-class AVL{
+class AVL : private AVLBase<AVL, AVLNode> {
  public:
  	AVL();
+ 	AVL(const AVL&) = delete;
+ 	AVL& operator=(const AVL&) = delete;
+ 	AVL(AVL&& other);
+ 	AVL& operator=(AVL&& other);
+
+ 	// in-order iteration over the keys, see TreeIterator.h
+ 	typedef TreeIterator<AVLNode> const_iterator;
+ 	typedef const_iterator iterator;
+ 	const_iterator begin() const;
+ 	const_iterator end() const;
+ 	// first key >= key and first key > key, so a range scan over [lo, hi]
+ 	// costs O(log n + k) and allocates nothing
+ 	const_iterator lower_bound(int key) const;
+ 	const_iterator upper_bound(int key) const;
+ 	std::pair<const_iterator, const_iterator> equal_range(int key) const;
 
  	void Insert(int key);
  	bool Delete(int key);
  	bool Find(int key) const;
- 	std::string JSON() const;
+ 	// out[i] = Find(keys[i]) for every i < count. Several descents advance
+ 	// in lock-step and prefetch their next node, so the cache misses of
+ 	// independent lookups overlap instead of being paid one after another.
+ 	void FindMany(const int* keys, size_t count, bool* out) const;
+ 	// big trees are rendered in pieces on pool, see JSONWriter.h; the
+ 	// output is the same for any pool
+ 	std::string JSON(ForkJoinPool& pool = ForkJoinPool::Default()) const;
+ 	// streams the same document as JSON() in key order through a fixed
+ 	// buffer, see JSONWriter.h; compact drops the whitespace
+ 	void WriteJSON(std::ostream& out, bool compact = false,
+ 		ForkJoinPool& pool = ForkJoinPool::Default()) const;
+ 	void WriteJSON(int fd, bool compact = false,
+ 		ForkJoinPool& pool = ForkJoinPool::Default()) const;
+	// what changed since the last call, as a patch against the JSON() of
+	// the tree back then: "created", "modified" and "removed" entries
+	// followed by "root" and "size", see ChangeLog.h. Apply "removed" first,
+	// then "created" and "modified", then "root" (dropped when absent) and
+	// "size". Costs O(log n) per change, except for the first delta and
+	// after Split, Join, the set operations, BuildFromSorted, Load or
+	// FromJSON, which publish the whole tree with "reset": true, to be
+	// applied to an empty document. Heights are not part of JSON(), so a
+	// node whose height alone changed is deliberately left out.
+	// Copies of a key share one entry, which is merged from all of them
+	// again whenever one changes: a key with c copies costs O(c log n) per
+	// delta that touches it, however few of the copies changed.
+	std::string JSONDelta();
+	void WriteJSONDelta(std::ostream& out, bool compact = false);
+	void WriteJSONDelta(int fd, bool compact = false);
  	size_t size() const;
  	bool empty() const;
+ 	// walks the whole tree and checks that every node's height,
+ 	// balance_factor, subtree_size and parent link agree with its children
+ 	// and that |balance_factor| <= 1, i.e. the AVL invariant; O(n), for tests
+ 	bool IsBalanced() const;
  	int DeleteMin();
-	int UpdateHeight(std::shared_ptr<AVLNode> currentNode); 
-	void rebalance(std::shared_ptr<AVLNode> currentNode); 
-    // void rightrotation(std::shared_ptr<AVLNode> currentNode ); 
-    // void leftrotation(std::shared_ptr<AVLNode>currentNode);
-    
-    
-    
+ 	// order statistics in O(log n) from the subtree_size of each node:
+ 	// number of keys < key, the k-th smallest key (0-based), and the number
+ 	// of keys in [lo, hi]
+ 	size_t Rank(int key) const;
+ 	int Select(size_t k) const;
+ 	size_t CountRange(int lo, int hi) const;
+ 	// replaces the contents with a perfectly balanced tree over the sorted
+ 	// range [first, last) in O(n), no comparisons or rotations involved;
+ 	// random access ranges are read in place, others are copied first
+ 	template <class Iterator>
+ 	void BuildFromSorted(Iterator first, Iterator last);
+ 	// same for an arbitrary range, which is sorted (and optionally
+ 	// deduplicated) first
+ 	template <class Iterator>
+ 	void Build(Iterator first, Iterator last, bool deduplicate = false);
+ 	// moves every key < key into first and every key >= key into second in
+ 	// O(log n), this tree is left empty
+ 	std::pair<AVL, AVL> Split(int key);
+ 	// concatenates left, pivot and right in O(|height difference| + 1);
+ 	// needs every key of left <= pivot <= every key of right. Both inputs
+ 	// are left empty.
+ 	static AVL Join(AVL&& left, int pivot, AVL&& right);
+ 	// same without a pivot, every key of left <= every key of right
+ 	static AVL Join(AVL&& left, AVL&& right);
+ 	// set operations built from Split/Join, O(m log(n/m + 1)) work for
+ 	// sizes m <= n, with the recursive halves run on pool. Inputs are
+ 	// treated as sets (no duplicate keys) and are left empty.
+ 	static AVL Union(AVL&& a, AVL&& b, ForkJoinPool& pool = ForkJoinPool::Default());
+ 	static AVL Intersection(AVL&& a, AVL&& b, ForkJoinPool& pool = ForkJoinPool::Default());
+ 	// keys of a that are not in b
+ 	static AVL Difference(AVL&& a, AVL&& b, ForkJoinPool& pool = ForkJoinPool::Default());
+	// read-only copy of the keys in Eytzinger order, built in O(n); later
+	// updates to this tree do not show up in it
+	FrozenAVL Freeze() const;
+	// writes the keys in order and the height of every node to path, in
+	// the versioned, checksummed snapshot format described in MappedAVL.h,
+	// gathering big trees on pool; the file is the same for any pool
+	void Save(const std::string& path, ForkJoinPool& pool = ForkJoinPool::Default()) const;
+	// rebuilds the exact tree Save wrote in O(n), with no comparisons or
+	// rotations; exits if path is corrupt or not an AVL snapshot. To query
+	// a snapshot without building a tree at all, map it with MappedAVL.
+	static AVL Load(const std::string& path);
+	// rebuilds the exact tree a JSON() document describes in O(n), see
+	// JSONReader.h; heights are recomputed bottom-up and the shape must be
+	// balanced. Exits with a message on anything else.
+	static AVL FromJSON(std::istream& in);
+	static AVL FromJSON(const std::string& document);
+	int UpdateHeight(AVLNode* currentNode); 
+	void rebalance(AVLNode* currentNode); 
+
  private:
-	void DeleteLeaf(std::shared_ptr<AVLNode> currentNode);
-	int DeleteMin(std::shared_ptr<AVLNode> currentNode);
+	int DeleteMin(AVLNode* currentNode);
+	// joins two detached subtrees around a detached pivot node whose key
+	// lies between them and returns the new detached root
+	AVLNode* JoinNodes(AVLNode* left, AVLNode* pivot, AVLNode* right);
+	AVLNode* JoinNodes(AVLNode* left, AVLNode* right);
+	// hands the changes since the last delta to writer and starts over
+	void WriteDelta(JSONWriter& writer);
+	// gives this tree a pool of its own unless nobody else shares it
+	void ResetPool();
+	// a pool that owns the nodes of both a and b
+	static std::shared_ptr< NodePool<AVLNode> > MergePools(
+		const std::shared_ptr< NodePool<AVLNode> >& a,
+		const std::shared_ptr< NodePool<AVLNode> >& b);
+	// splits a detached subtree into keys < key and keys >= key; with found
+	// set, a node equal to key is taken out and returned there instead
+	std::pair<AVLNode*, AVLNode*> SplitNodes(AVLNode* root, int key, AVLNode** found);
+	static void DetachChildren(AVLNode* node);
+
+	struct SetContext {
+		ForkJoinPool* forkJoin;
+		// recursion depth below which halves are forked
+		int maxDepth;
+		// subtrees dropped by the operation, freed once it has finished
+		std::mutex mutex;
+		std::vector<AVLNode*> discarded;
+	};
+	static AVL SetOperation(AVL&& a, AVL&& b, ForkJoinPool& pool,
+		AVLNode* (AVL::*operation)(AVLNode*, AVLNode*, SetContext&, int));
+	template <class Left, class Right>
+	static void ForkJoin(SetContext& context, int depth, size_t work, Left left, Right right);
+	static void Discard(AVLNode* subtree, SetContext& context);
+	AVLNode* UnionNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth);
+	AVLNode* IntersectionNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth);
+	AVLNode* DifferenceNodes(AVLNode* a, AVLNode* b, SetContext& context, int depth);
+	template <class Iterator>
+	void BuildSorted(Iterator first, Iterator last, std::random_access_iterator_tag);
+	template <class Iterator>
+	void BuildSorted(Iterator first, Iterator last, std::input_iterator_tag);
+	// empties the tree for a build of n nodes
+	void ClearForBuild(size_t n);
+	template <class Iterator>
+	AVLNode* BuildBalanced(Iterator keys, size_t n, AVLNode* parent);
+	static int Height(const AVLNode* node);
+	// height of node's subtree as its children give it, -2 if anything in
+	// it breaks IsBalanced's checks
+	static int CheckSubtree(const AVLNode* node, const AVLNode* parent);
+	static size_t Size(const AVLNode* node);
+	// number of keys <= key
+	size_t RankUpper(int key) const;
+	// recomputes height, balance_factor and subtree_size from the children
+	static void FixNode(AVLNode* node);
+	// the hooks of AVLBase: subtree_size is the augmentation, and links
+	// that change are entries of the next JSONDelta
+	static const bool kAugmented = true;
+	static void FixAugment(AVLNode* node);
+	void Linked(AVLNode* node);
+	void Rotated(AVLNode* node, bool left);
+	// fills in balance_factor and subtree_size of a node rebuilt by Load or
+	// FromJSON from its children, false if its height does not fit them
+	static bool RestoreNode(AVLNode* node);
+	// heights of a tree FromJSON has just linked, bottom-up; exits if the
+	// shape is not balanced
+	void RestoreHeights();
+	// deepest node reached by always preferring the left child, i.e. the
+	// first node a post-order walk of currentNode's subtree visits
+	static AVLNode* FirstPostOrder(AVLNode* currentNode);
     
-	std::shared_ptr<AVLNode> root_;
  	size_t size_;
+	// owns every node, ~AVL releases it slab by slab without a tree walk.
+	// Split hands it to the left half and lets the right one keep its
+	// slabs, Join adopts the right tree's slabs and free list into it.
+	std::shared_ptr< NodePool<AVLNode> > pool_;
+	// nodes changed since the last JSONDelta
+	ChangeLog<AVLNode> changes_;
+
+	friend AVLBase<AVL, AVLNode>;
+
+
+}; // class AVL
+
+template <class Iterator>
+void AVL::BuildFromSorted(Iterator first, Iterator last) {
+	BuildSorted(first, last, typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+template <class Iterator>
+void AVL::BuildSorted(Iterator first, Iterator last, std::random_access_iterator_tag) {
+	assert(std::is_sorted(first, last));
+	size_t n = last - first;
+	ClearForBuild(n);
+	root_ = BuildBalanced(first, n, nullptr);
+	size_ = n;
+}
+
+template <class Iterator>
+void AVL::BuildSorted(Iterator first, Iterator last, std::input_iterator_tag) {
+	std::vector<int> keys(first, last);
+	BuildSorted(keys.cbegin(), keys.cend(), std::random_access_iterator_tag());
+}
+
+// recursion depth is log2(n), the halves never differ by more than one key
+template <class Iterator>
+AVLNode* AVL::BuildBalanced(Iterator keys, size_t n, AVLNode* parent) {
+	if (n == 0) {
+		return nullptr;
+	}
+	size_t mid = n / 2;
+	AVLNode* node = pool_->Allocate(keys[mid], parent);
+	node->left_ = BuildBalanced(keys, mid, node);
+	node->right_ = BuildBalanced(keys + mid + 1, n - mid - 1, node);
+	FixNode(node);
+	return node;
+}
 
+template <class Iterator>
+void AVL::Build(Iterator first, Iterator last, bool deduplicate) {
+	std::vector<int> keys(first, last);
+	std::sort(keys.begin(), keys.end());
+	if (deduplicate) {
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	}
+	BuildSorted(keys.cbegin(), keys.cend(), std::random_access_iterator_tag());
+}
 
-}; // class AVL
\ No newline at end of file
+#endif // AVL_H
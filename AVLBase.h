@@ -0,0 +1,183 @@
+#ifndef AVLBASE_H
+#define AVLBASE_H
+
+// The rebalancing core of AVL, shared with the trees that keep something
+// else in their nodes (AggregateAVL, AVLMap): the rotations, the retrace
+// from a changed node back up to the root, and unlinking a node with at
+// most one child. Tree derives from AVLBase<Tree, Node> and befriends it,
+// and Node has parent_, left_ and right_ and befriends it too. Tree
+// provides
+//
+//   static int Height(const Node* node);   -1 for null
+//   static void FixNode(Node* node);       height and anything else kept
+//                                          in node, from its children
+//
+// and may hide these defaults, which are resolved at compile time:
+//
+//   static const bool kAugmented;          nodes keep a value over their
+//                                          whole subtree, which changes all
+//                                          the way up even once heights
+//                                          stop changing
+//   static void FixAugment(Node* node);    only that value
+//   void Linked(Node* node);               node's links changed, null too
+//   void Rotated(Node* node, bool left);   before a rotation around node
+template <class Tree, class Node>
+class AVLBase {
+ protected:
+	AVLBase() : root_(nullptr) {}
+
+	// walks parent_ links from currentNode to the root fixing every node,
+	// rotating wherever it leans by more than one; once a subtree height
+	// comes out unchanged only the augmentation is updated
+	void UpdateAncestors(Node* currentNode);
+	// rotates a node that leans by two back into balance and returns the
+	// root of its subtree
+	Node* Rebalance(Node* currentNode);
+	void RotateLeft(Node* currentNode);
+	void RotateRight(Node* currentNode);
+	void ReplaceSubtree(Node* parent, Node* oldChild, Node* newChild);
+	// takes node, which has at most one child, out of the tree and retraces
+	// from its parent; node itself is left to the caller
+	void Unlink(Node* node);
+	// unlinks the minimum of currentNode's subtree and returns it detached
+	Node* ExtractMin(Node* currentNode);
+
+	static const bool kAugmented = false;
+	static void FixAugment(Node*) {}
+	void Linked(Node*) {}
+	void Rotated(Node*, bool) {}
+
+	Node* root_;
+
+ private:
+	Tree& Self() { return static_cast<Tree&>(*this); }
+	static int Balance(const Node* node);
+}; // class AVLBase
+
+template <class Tree, class Node>
+void AVLBase<Tree, Node>::UpdateAncestors(Node* currentNode) {
+	while (currentNode != nullptr) {
+		int oldHeight = Tree::Height(currentNode);
+		Tree::FixNode(currentNode);
+		int balance = Balance(currentNode);
+		if (balance > 1 || balance < -1) {
+			currentNode = Rebalance(currentNode);
+		}
+		if (Tree::Height(currentNode) == oldHeight) {
+			// heights and balance above are unaffected
+			if (Tree::kAugmented) {
+				for (currentNode = currentNode->parent_; currentNode != nullptr;
+						currentNode = currentNode->parent_) {
+					Tree::FixAugment(currentNode);
+				}
+			}
+			return;
+		}
+		currentNode = currentNode->parent_;
+	}
+}
+
+template <class Tree, class Node>
+Node* AVLBase<Tree, Node>::Rebalance(Node* currentNode) {
+	int balance = Balance(currentNode);
+	if (balance > 1) {
+		// right heavy: RR case, or RL case if the right child leans left
+		if (Balance(currentNode->right_) < 0) {
+			RotateRight(currentNode->right_);
+		}
+		RotateLeft(currentNode);
+		return currentNode->parent_;
+	}
+	if (balance < -1) {
+		// left heavy: LL case, or LR case if the left child leans right
+		if (Balance(currentNode->left_) > 0) {
+			RotateLeft(currentNode->left_);
+		}
+		RotateRight(currentNode);
+		return currentNode->parent_;
+	}
+	return currentNode;
+}
+
+template <class Tree, class Node>
+void AVLBase<Tree, Node>::RotateLeft(Node* currentNode) {
+	Self().Rotated(currentNode, true);
+	Node* pivot = currentNode->right_;
+	Node* parent = currentNode->parent_;
+	currentNode->right_ = pivot->left_;
+	if (currentNode->right_ != nullptr) {
+		currentNode->right_->parent_ = currentNode;
+	}
+	pivot->left_ = currentNode;
+	currentNode->parent_ = pivot;
+	ReplaceSubtree(parent, currentNode, pivot);
+	Self().Linked(currentNode);
+	Self().Linked(currentNode->right_);
+	Tree::FixNode(currentNode);
+	Tree::FixNode(pivot);
+}
+
+template <class Tree, class Node>
+void AVLBase<Tree, Node>::RotateRight(Node* currentNode) {
+	Self().Rotated(currentNode, false);
+	Node* pivot = currentNode->left_;
+	Node* parent = currentNode->parent_;
+	currentNode->left_ = pivot->right_;
+	if (currentNode->left_ != nullptr) {
+		currentNode->left_->parent_ = currentNode;
+	}
+	pivot->right_ = currentNode;
+	currentNode->parent_ = pivot;
+	ReplaceSubtree(parent, currentNode, pivot);
+	Self().Linked(currentNode);
+	Self().Linked(currentNode->left_);
+	Tree::FixNode(currentNode);
+	Tree::FixNode(pivot);
+}
+
+template <class Tree, class Node>
+void AVLBase<Tree, Node>::ReplaceSubtree(Node* parent, Node* oldChild, Node* newChild) {
+	if (newChild != nullptr) {
+		newChild->parent_ = parent;
+	}
+	if (parent == nullptr) {
+		// oldChild may also be the root of a detached subtree (AVL's Split,
+		// Join and set operations), which must leave root_ alone
+		if (root_ == oldChild) {
+			root_ = newChild;
+		}
+	} else if (parent->left_ == oldChild) {
+		parent->left_ = newChild;
+	} else {
+		parent->right_ = newChild;
+	}
+	Self().Linked(parent);
+	Self().Linked(newChild);
+}
+
+template <class Tree, class Node>
+void AVLBase<Tree, Node>::Unlink(Node* node) {
+	Node* child = (node->left_ != nullptr) ? node->left_ : node->right_;
+	Node* parent = node->parent_;
+	ReplaceSubtree(parent, node, child);
+	UpdateAncestors(parent);
+}
+
+template <class Tree, class Node>
+Node* AVLBase<Tree, Node>::ExtractMin(Node* currentNode) {
+	Node* lastNode = nullptr;
+	while (currentNode != nullptr) {
+		lastNode = currentNode;
+		currentNode = currentNode->left_;
+	}
+	Unlink(lastNode);
+	lastNode->parent_ = lastNode->right_ = nullptr;
+	return lastNode;
+}
+
+template <class Tree, class Node>
+int AVLBase<Tree, Node>::Balance(const Node* node) {
+	return Tree::Height(node->right_) - Tree::Height(node->left_);
+}
+
+#endif // AVLBASE_H
@@ -0,0 +1,380 @@
+#ifndef AVLMAP_H
+#define AVLMAP_H
+
+// Header-only AVL map from Key to Value, ordered by Compare. The value lives
+// in the node next to the key, so one descent answers a lookup. Compare is a
+// template parameter and is inlined; when Key is a trivially copyable integer
+// ordered by std::less, Find switches to a descent that never tests for
+// equality on the way down and only selects between left_ and right_, which
+// the compiler turns into conditional moves instead of branches.
+//
+// Unlike AVL this is a map, not a multiset: Insert on a present key replaces
+// its value. JSON() emits the same shape schema as AVL::JSON(), the values
+// are not part of it, and Key has to be convertible to nlohmann::json.
+// Rotations and the retrace are AVL's own, see AVLBase.h.
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "AVLBase.h"
+#include "json.hpp"
+
+template <class Key, class Value, class Compare, class Alloc>
+class AVLMap;
+
+template <class Key, class Value>
+class AVLMapNode {
+ public:
+	template <class K, class V>
+	AVLMapNode(K&& key, V&& value, AVLMapNode* parent) :
+		key_(std::forward<K>(key)),
+		value_(std::forward<V>(value)),
+		height_(0),
+		parent_(parent),
+		left_(nullptr),
+		right_(nullptr) {}
+
+ private:
+	Key key_;
+	Value value_;
+	int height_;
+	AVLMapNode* parent_;
+	AVLMapNode* left_;
+	AVLMapNode* right_;
+
+	template <class K, class V, class C, class A>
+	friend class AVLMap;
+	template <class Tree, class Node>
+	friend class AVLBase;
+}; // class AVLMapNode
+
+template <class Key, class Value, class Compare = std::less<Key>,
+	class Alloc = std::allocator< std::pair<const Key, Value> > >
+class AVLMap : private AVLBase<AVLMap<Key, Value, Compare, Alloc>, AVLMapNode<Key, Value> > {
+ public:
+	AVLMap();
+	explicit AVLMap(const Compare& compare, const Alloc& alloc = Alloc());
+	~AVLMap();
+	AVLMap(const AVLMap&) = delete;
+	AVLMap& operator=(const AVLMap&) = delete;
+	AVLMap(AVLMap&& other);
+	AVLMap& operator=(AVLMap&& other);
+
+	// returns false and overwrites the value if key was already present
+	template <class K, class V>
+	bool Insert(K&& key, V&& value);
+	bool Delete(const Key& key);
+	// pointer to the value stored under key, nullptr if absent. Stays valid
+	// until the key is deleted or another Delete/DeleteMin moves it.
+	Value* Find(const Key& key);
+	const Value* Find(const Key& key) const;
+	std::string JSON() const;
+	size_t size() const;
+	bool empty() const;
+	std::pair<Key, Value> DeleteMin();
+	void Clear();
+
+ private:
+	typedef AVLMapNode<Key, Value> Node;
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+	typedef std::allocator_traits<NodeAlloc> NodeAllocTraits;
+	typedef AVLBase<AVLMap, Node> Base;
+	using Base::root_;
+	using Base::UpdateAncestors;
+	// trivially copyable integer keys under the default order take the
+	// branch-light descent in Find
+	typedef std::integral_constant<bool,
+		std::is_integral<Key>::value &&
+		std::is_trivially_copyable<Key>::value &&
+		(std::is_same<Compare, std::less<Key> >::value ||
+		 std::is_same<Compare, std::less<> >::value)> FastKeys;
+
+	Node* FindNode(const Key& key) const;
+	Node* FindNode(const Key& key, std::true_type) const;
+	Node* FindNode(const Key& key, std::false_type) const;
+	std::pair<Key, Value> DeleteMin(Node* currentNode);
+	// unlinks and destroys node, which has at most one child
+	void Remove(Node* node);
+	void DestroyNode(Node* node);
+	static int Height(const Node* node);
+	static void FixNode(Node* node);
+	static std::string KeyName(const nlohmann::json& key);
+
+	size_t size_;
+	Compare compare_;
+	NodeAlloc alloc_;
+
+	friend Base;
+}; // class AVLMap
+
+template <class Key, class Value, class Compare, class Alloc>
+AVLMap<Key, Value, Compare, Alloc>::AVLMap() : size_(0) {}
+
+template <class Key, class Value, class Compare, class Alloc>
+AVLMap<Key, Value, Compare, Alloc>::AVLMap(const Compare& compare, const Alloc& alloc) :
+	size_(0),
+	compare_(compare),
+	alloc_(alloc) {}
+
+template <class Key, class Value, class Compare, class Alloc>
+AVLMap<Key, Value, Compare, Alloc>::~AVLMap() {
+	Clear();
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+AVLMap<Key, Value, Compare, Alloc>::AVLMap(AVLMap&& other) :
+	size_(other.size_),
+	compare_(std::move(other.compare_)),
+	alloc_(std::move(other.alloc_)) {
+	root_ = other.root_;
+	other.root_ = nullptr;
+	other.size_ = 0;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+AVLMap<Key, Value, Compare, Alloc>& AVLMap<Key, Value, Compare, Alloc>::operator=(AVLMap&& other) {
+	if (this != &other) {
+		Clear();
+		root_ = other.root_;
+		size_ = other.size_;
+		compare_ = std::move(other.compare_);
+		alloc_ = std::move(other.alloc_);
+		other.root_ = nullptr;
+		other.size_ = 0;
+	}
+	return *this;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+template <class K, class V>
+bool AVLMap<Key, Value, Compare, Alloc>::Insert(K&& key, V&& value) {
+	Node *currentNode = root_, *lastNode = nullptr;
+	bool goLeft = false;
+	while (currentNode != nullptr) {
+		lastNode = currentNode;
+		if (compare_(key, currentNode->key_)) {
+			goLeft = true;
+			currentNode = currentNode->left_;
+		} else if (compare_(currentNode->key_, key)) {
+			goLeft = false;
+			currentNode = currentNode->right_;
+		} else {
+			currentNode->value_ = std::forward<V>(value);
+			return false;
+		}
+	}
+	Node* node = NodeAllocTraits::allocate(alloc_, 1);
+	NodeAllocTraits::construct(alloc_, node,
+		std::forward<K>(key), std::forward<V>(value), lastNode);
+	if (lastNode == nullptr) {
+		root_ = node;
+	} else if (goLeft) {
+		lastNode->left_ = node;
+	} else {
+		lastNode->right_ = node;
+	}
+	size_++;
+	UpdateAncestors(lastNode);
+	return true;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+bool AVLMap<Key, Value, Compare, Alloc>::Delete(const Key& key) {
+	Node* currentNode = FindNode(key);
+	if (currentNode == nullptr) {
+		return false;
+	}
+	if (currentNode->left_ != nullptr && currentNode->right_ != nullptr) {
+		Node* successor = currentNode->right_;
+		while (successor->left_ != nullptr) {
+			successor = successor->left_;
+		}
+		currentNode->key_ = std::move(successor->key_);
+		currentNode->value_ = std::move(successor->value_);
+		currentNode = successor;
+	}
+	Remove(currentNode);
+	return true;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+Value* AVLMap<Key, Value, Compare, Alloc>::Find(const Key& key) {
+	Node* node = FindNode(key);
+	return (node == nullptr) ? nullptr : &node->value_;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+const Value* AVLMap<Key, Value, Compare, Alloc>::Find(const Key& key) const {
+	Node* node = FindNode(key);
+	return (node == nullptr) ? nullptr : &node->value_;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+std::string AVLMap<Key, Value, Compare, Alloc>::JSON() const {
+	nlohmann::json result;
+	if (root_ != nullptr) {
+		result["root"] = root_->key_;
+		// pre-order, the objects are keyed by name so the order does not show
+		Node* currentNode = root_;
+		while (currentNode != nullptr) {
+			nlohmann::json& entry = result[KeyName(currentNode->key_)];
+			if (currentNode->left_ != nullptr) {
+				entry["left"] = currentNode->left_->key_;
+			}
+			if (currentNode->right_ != nullptr) {
+				entry["right"] = currentNode->right_->key_;
+			}
+			if (currentNode->parent_ != nullptr) {
+				entry["parent"] = currentNode->parent_->key_;
+			} else {
+				entry["root"] = true;
+			}
+			if (currentNode->left_ != nullptr) {
+				currentNode = currentNode->left_;
+			} else if (currentNode->right_ != nullptr) {
+				currentNode = currentNode->right_;
+			} else {
+				// climb until we come up out of a left subtree that has a
+				// right sibling still to visit
+				Node* child = currentNode;
+				currentNode = currentNode->parent_;
+				while (currentNode != nullptr &&
+						(child == currentNode->right_ || currentNode->right_ == nullptr)) {
+					child = currentNode;
+					currentNode = currentNode->parent_;
+				}
+				if (currentNode != nullptr) {
+					currentNode = currentNode->right_;
+				}
+			}
+		}
+	}
+	result["size"] = size_;
+	return result.dump(2) + "\n";
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+size_t AVLMap<Key, Value, Compare, Alloc>::size() const {
+	return size_;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+bool AVLMap<Key, Value, Compare, Alloc>::empty() const {
+	return size_ == 0;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+std::pair<Key, Value> AVLMap<Key, Value, Compare, Alloc>::DeleteMin() {
+	return DeleteMin(root_);
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void AVLMap<Key, Value, Compare, Alloc>::Clear() {
+	// post-order through the parent links, no stack needed
+	Node* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (currentNode->left_ != nullptr) {
+			currentNode = currentNode->left_;
+		} else if (currentNode->right_ != nullptr) {
+			currentNode = currentNode->right_;
+		} else {
+			Node* parent = currentNode->parent_;
+			if (parent != nullptr) {
+				if (parent->left_ == currentNode) {
+					parent->left_ = nullptr;
+				} else {
+					parent->right_ = nullptr;
+				}
+			}
+			DestroyNode(currentNode);
+			currentNode = parent;
+		}
+	}
+	root_ = nullptr;
+	size_ = 0;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+typename AVLMap<Key, Value, Compare, Alloc>::Node*
+AVLMap<Key, Value, Compare, Alloc>::FindNode(const Key& key) const {
+	return FindNode(key, FastKeys());
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+typename AVLMap<Key, Value, Compare, Alloc>::Node*
+AVLMap<Key, Value, Compare, Alloc>::FindNode(const Key& key, std::true_type) const {
+	// lower_bound descent: remember the last node whose key is not below
+	// key and check for equality once at the bottom
+	Node* currentNode = root_;
+	Node* candidate = nullptr;
+	while (currentNode != nullptr) {
+		bool below = currentNode->key_ < key;
+		candidate = below ? candidate : currentNode;
+		currentNode = below ? currentNode->right_ : currentNode->left_;
+	}
+	return (candidate != nullptr && candidate->key_ == key) ? candidate : nullptr;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+typename AVLMap<Key, Value, Compare, Alloc>::Node*
+AVLMap<Key, Value, Compare, Alloc>::FindNode(const Key& key, std::false_type) const {
+	Node* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (compare_(key, currentNode->key_)) {
+			currentNode = currentNode->left_;
+		} else if (compare_(currentNode->key_, key)) {
+			currentNode = currentNode->right_;
+		} else {
+			return currentNode;
+		}
+	}
+	return nullptr;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+std::pair<Key, Value> AVLMap<Key, Value, Compare, Alloc>::DeleteMin(Node* currentNode) {
+	Node* lastNode = nullptr;
+	while (currentNode != nullptr) {
+		lastNode = currentNode;
+		currentNode = currentNode->left_;
+	}
+	std::pair<Key, Value> result(std::move(lastNode->key_), std::move(lastNode->value_));
+	Remove(lastNode);
+	return result;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void AVLMap<Key, Value, Compare, Alloc>::Remove(Node* node) {
+	Base::Unlink(node);
+	DestroyNode(node);
+	size_--;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void AVLMap<Key, Value, Compare, Alloc>::DestroyNode(Node* node) {
+	NodeAllocTraits::destroy(alloc_, node);
+	NodeAllocTraits::deallocate(alloc_, node, 1);
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+int AVLMap<Key, Value, Compare, Alloc>::Height(const Node* node) {
+	return (node == nullptr) ? -1 : node->height_;
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void AVLMap<Key, Value, Compare, Alloc>::FixNode(Node* node) {
+	node->height_ = 1 + std::max(Height(node->left_), Height(node->right_));
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+std::string AVLMap<Key, Value, Compare, Alloc>::KeyName(const nlohmann::json& key) {
+	// same object keys as AVL::JSON() for numbers, strings stay unquoted
+	return key.is_string() ? key.get<std::string>() : key.dump();
+}
+
+#endif // AVLMAP_H
@@ -0,0 +1,102 @@
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "AVL.h"
+#include "AVLMap.h"
+#include "json.hpp"
+
+#define SAMPLE_SIZE 1000
+#define NUM_TESTS 1000
+
+// random updates on T and on a std::map model, key(x) and value(x) turn the
+// drawn ints into Key and Value
+template <class Key, class Value, class MakeKey, class MakeValue>
+void CheckAgainstMap(std::mt19937_64& rng, MakeKey key, MakeValue value) {
+	// small range, so inserts overwrite and deletes hit
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE);
+	std::uniform_int_distribution<int> op(0, 3);
+	AVLMap<Key, Value> T;
+	std::map<Key, Value> model;
+	for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+		Key k = key(unif(rng));
+		switch (op(rng)) {
+		case 0: {
+			bool deleted = T.Delete(k);
+			assert(deleted == (model.erase(k) != 0));
+			break;
+		}
+		case 1:
+			if (!model.empty()) {
+				std::pair<Key, Value> min = T.DeleteMin();
+				assert(min.first == model.begin()->first);
+				assert(min.second == model.begin()->second);
+				model.erase(model.begin());
+			}
+			break;
+		default: {
+			Value v = value(unif(rng));
+			bool inserted = T.Insert(k, v);
+			assert(inserted == (model.count(k) == 0));
+			model[k] = v;
+		}
+		}
+		const Value* found = T.Find(k);
+		auto expected = model.find(k);
+		assert((found != nullptr) == (expected != model.end()));
+		assert(found == nullptr || *found == expected->second);
+		assert(T.size() == model.size());
+	}
+	for (auto& entry : model) {
+		const Value* found = T.Find(entry.first);
+		assert(found != nullptr && *found == entry.second);
+	}
+	while (!T.empty()) {
+		std::pair<Key, Value> min = T.DeleteMin();
+		assert(min.first == model.begin()->first);
+		assert(min.second == model.begin()->second);
+		model.erase(model.begin());
+	}
+	assert(model.empty());
+}
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE);
+
+	std::cout << "Running tests..." << std::flush;
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		// int keys take the FastKeys descent in Find, strings the compare_ one
+		CheckAgainstMap<int, int>(rng,
+			[](int x) { return x; },
+			[](int x) { return -x; });
+		CheckAgainstMap<std::string, std::string>(rng,
+			[](int x) { return std::to_string(x); },
+			[](int x) { return std::string(x % 64, 'v'); });
+		// both insert by the same rotations, so distinct keys give the same
+		// shape as AVL
+		if (sample % 10 == 0) {
+			AVLMap<int, int> T;
+			AVL reference;
+			std::set<int> keys;
+			while (keys.size() < SAMPLE_SIZE) {
+				int x = unif(rng) * SAMPLE_SIZE + unif(rng);
+				if (keys.insert(x).second) {
+					T.Insert(x, x);
+					reference.Insert(x);
+				}
+			}
+			assert(nlohmann::json::parse(T.JSON()) == nlohmann::json::parse(reference.JSON()));
+		}
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+	std::cout << "Tests complete.\n";
+}
@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "AVL.h"
+#include "AggregateAVL.h"
+#include "CompactAVL.h"
+#include "MappedAVL.h"
+#include "SanityCheck.h"
+#include "TreePartition.h"
+#include "json.hpp"
+
+#define SAMPLE_SIZE 1000
+#define NUM_TESTS 10000
+#define SNAPSHOT "AVLSanityCheck.avl"
+
+// Aggregate(lo, hi) of a tree over keys, after some deletes, against a
+// fold over the keys left
+template <class Monoid>
+void CheckAggregates(std::vector<int> keys, std::mt19937_64& rng) {
+	AggregateAVL<Monoid> tree;
+	std::shuffle(keys.begin(), keys.end(), rng);
+	for (int key : keys) {
+		tree.Insert(key);
+	}
+	std::sort(keys.begin(), keys.end());
+	for (size_t i = keys.size(); i-- > 0; ) {
+		if (i % 3 == 0) {
+			assert(tree.Delete(keys[i]));
+			keys.erase(keys.begin() + i);
+		}
+	}
+	for (int i = 0; i < 10 && !keys.empty(); i++) {
+		assert(tree.DeleteMin() == keys.front());
+		keys.erase(keys.begin());
+	}
+	assert(tree.size() == keys.size());
+	std::uniform_int_distribution<size_t> pick(0, keys.size());
+	for (int i = 0; i < 20; i++) {
+		// ends on keys and just off them, empty and reversed ranges too
+		int lo = keys.empty() ? 0 : keys[pick(rng) % keys.size()] - (i % 2);
+		int hi = keys.empty() ? 0 : keys[pick(rng) % keys.size()] + (i % 3 == 0);
+		typename Monoid::value_type expected = Monoid::Identity();
+		for (int key : keys) {
+			if (lo <= key && key <= hi) {
+				expected = Monoid::Combine(expected, Monoid::Lift(key));
+			}
+		}
+		assert(tree.Aggregate(lo, hi) == expected);
+	}
+	typename Monoid::value_type all = Monoid::Identity();
+	for (int key : keys) {
+		all = Monoid::Combine(all, Monoid::Lift(key));
+	}
+	assert(tree.Aggregate() == all);
+}
+
+// every set operation of a and b, distinct sorted keys, against <algorithm>
+void CheckSetOperations(const std::vector<int>& a, const std::vector<int>& b, ForkJoinPool& pool) {
+	for (int operation = 0; operation < 3; operation++) {
+		AVL first, second, result;
+		first.BuildFromSorted(a.begin(), a.end());
+		// b goes in key by key, so its shape is not a's
+		for (int key : b) {
+			second.Insert(key);
+		}
+		std::vector<int> expected;
+		if (operation == 0) {
+			std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+			result = AVL::Union(std::move(first), std::move(second), pool);
+		} else if (operation == 1) {
+			std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+			result = AVL::Intersection(std::move(first), std::move(second), pool);
+		} else {
+			std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+			result = AVL::Difference(std::move(first), std::move(second), pool);
+		}
+		assert(first.empty() && second.empty());
+		assert(result.IsBalanced() && result.size() == expected.size());
+		assert(std::vector<int>(result.begin(), result.end()) == expected);
+		// the result allocates from the merged pools
+		result.Insert(0);
+		assert(result.IsBalanced());
+	}
+}
+
+// distinct sorted keys: a random part of keys plus count new ones
+std::vector<int> Overlapping(const std::vector<int>& keys, size_t count, std::mt19937_64& rng) {
+	std::vector<int> result;
+	for (int key : keys) {
+		if (rng() % 2 == 0) {
+			result.push_back(key);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		result.push_back(static_cast<int>(rng()));
+	}
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
+
+// JSON() streams its members in numeric key order and merges copies of a
+// key itself, so it has to parse to the same document that nlohmann's DOM
+// built. CompactAVL still builds its JSON() that way, and updates by the
+// same rotations, so it serves as the reference.
+void CheckLegacyJSON(std::mt19937_64& rng) {
+	// small range, so keys repeat and copies land at every depth
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE / 20);
+	std::uniform_int_distribution<int> op(0, 5);
+	AVL T;
+	CompactAVL reference;
+	for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+		int x = unif(rng);
+		switch (op(rng)) {
+		case 0:
+			assert(T.Delete(x) == reference.Delete(x));
+			break;
+		case 1:
+			if (!T.empty()) {
+				assert(T.DeleteMin() == reference.DeleteMin());
+			}
+			break;
+		default:
+			T.Insert(x);
+			reference.Insert(x);
+		}
+	}
+	nlohmann::json document = nlohmann::json::parse(reference.JSON());
+	assert(nlohmann::json::parse(T.JSON()) == document);
+	std::ostringstream compact;
+	T.WriteJSON(compact, true);
+	assert(nlohmann::json::parse(compact.str()) == document);
+}
+
+void CheckDeltas(std::mt19937_64& rng) {
+	AVL T;
+	nlohmann::json document;
+	// a new tree has nothing to patch yet
+	assert(ApplyDelta(document, T.JSONDelta()));
+	UpdateAndPatch(T, document, rng);
+	std::vector<int> keys(T.begin(), T.end());
+	int key = keys.empty() ? 0 : keys[keys.size() / 2];
+	std::pair<AVL, AVL> halves = T.Split(key);
+	nlohmann::json lower, upper;
+	assert(ApplyDelta(lower, halves.first.JSONDelta()));
+	assert(ApplyDelta(upper, halves.second.JSONDelta()));
+	assert(lower == nlohmann::json::parse(halves.first.JSON()));
+	assert(upper == nlohmann::json::parse(halves.second.JSON()));
+	UpdateAndPatch(halves.first, lower, rng);
+	UpdateAndPatch(halves.second, upper, rng);
+	// keep the halves apart for Join
+	int middle = halves.second.empty() ? SAMPLE_SIZE : *halves.second.begin();
+	while (!halves.first.empty() && *std::prev(halves.first.end()) > middle) {
+		halves.first.Delete(*std::prev(halves.first.end()));
+	}
+	T = AVL::Join(std::move(halves.first), std::move(halves.second));
+	assert(ApplyDelta(document, T.JSONDelta()));
+	assert(document == nlohmann::json::parse(T.JSON()));
+	UpdateAndPatch(T, document, rng);
+	keys.assign(T.begin(), T.end());
+	T.BuildFromSorted(keys.begin(), keys.end());
+	assert(ApplyDelta(document, T.JSONDelta()));
+	assert(document == nlohmann::json::parse(T.JSON()));
+	UpdateAndPatch(T, document, rng);
+}
+
+// a corrupt snapshot makes MappedAVL and AVL::Load exit, so each gets a
+// child process to do it in
+bool Rejected(const std::string& path, bool load) {
+	pid_t child = fork();
+	if (child == 0) {
+		freopen("/dev/null", "w", stderr);
+		if (load) {
+			AVL::Load(path);
+		} else {
+			MappedAVL mapped(path);
+		}
+		_exit(0);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+std::string FileBytes(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// an empty tree round-trips, and a snapshot with any one byte changed, in
+// the header, a key or a height, is refused. Every byte position is tried,
+// so this does not depend on the seed.
+void CheckSnapshotFile() {
+	AVL empty;
+	empty.Save(SNAPSHOT);
+	assert(AVL::Load(SNAPSHOT).JSON() == empty.JSON());
+	{
+		MappedAVL mapped(SNAPSHOT);
+		assert(mapped.empty() && mapped.begin() == mapped.end());
+		assert(!mapped.Find(0) && mapped.Rank(0) == 0);
+	}
+	// the checksum alone, over a payload of SAMPLE_SIZE keys and heights
+	std::mt19937_64 rng(SAMPLE_SIZE);
+	AVL T;
+	for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+		T.Insert(static_cast<int>(rng()));
+	}
+	T.Save(SNAPSHOT);
+	std::string bytes = FileBytes(SNAPSHOT);
+	assert(bytes.size() == sizeof(MappedAVLHeader) + SAMPLE_SIZE * (sizeof(int) + 1));
+	std::string payload = bytes.substr(sizeof(MappedAVLHeader));
+	SnapshotChecksum whole;
+	whole.Update(payload.data(), payload.size());
+	const unsigned char flips[] = {0x01, 0x80, 0xff};
+	for (size_t at = 0; at < payload.size(); at++) {
+		for (unsigned char flip : flips) {
+			std::string corrupt(payload);
+			corrupt[at] ^= static_cast<char>(flip);
+			SnapshotChecksum checksum;
+			checksum.Update(corrupt.data(), corrupt.size());
+			assert(checksum.Value() != whole.Value());
+		}
+	}
+	// and the readers, over a file small enough to fork for every byte
+	AVL small;
+	for (int i = 0; i < 64; i++) {
+		small.Insert(static_cast<int>(rng()));
+	}
+	small.Save(SNAPSHOT);
+	bytes = FileBytes(SNAPSHOT);
+	assert(!Rejected(SNAPSHOT, false) && !Rejected(SNAPSHOT, true));
+	for (size_t at = 0; at < bytes.size(); at++) {
+		std::string corrupt(bytes);
+		corrupt[at] ^= static_cast<char>(1 + at % 255);
+		std::ofstream out(SNAPSHOT, std::ios::binary | std::ios::trunc);
+		out.write(corrupt.data(), corrupt.size());
+		out.close();
+		assert(Rejected(SNAPSHOT, false));
+		assert(Rejected(SNAPSHOT, true));
+	}
+	std::remove(SNAPSHOT);
+}
+
+// one tree split and joined over and over, with both halves updated in
+// between so each allocates from and frees into its own pool: the pools
+// must not pile up behind one another
+void CheckSplitJoinChurn(std::mt19937_64& rng) {
+	std::uniform_int_distribution<int> unif(0, 4 * SAMPLE_SIZE);
+	AVL T;
+	std::vector<int> keys;
+	for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+		keys.push_back(unif(rng));
+		T.Insert(keys.back());
+	}
+	std::sort(keys.begin(), keys.end());
+	for (int cycle = 0; cycle < 500; cycle++) {
+		int key = unif(rng);
+		std::pair<AVL, AVL> halves = T.Split(key);
+		for (int i = 0; i < 4; i++) {
+			int x = unif(rng);
+			(x < key ? halves.first : halves.second).Insert(x);
+			keys.insert(std::upper_bound(keys.begin(), keys.end(), x), x);
+		}
+		if (!halves.second.empty()) {
+			int minimum = halves.second.DeleteMin();
+			keys.erase(std::lower_bound(keys.begin(), keys.end(), minimum));
+		}
+		if (cycle % 2 == 0) {
+			T = AVL::Join(std::move(halves.first), std::move(halves.second));
+		} else {
+			T = AVL::Join(std::move(halves.first), key, std::move(halves.second));
+			keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+		}
+		assert(T.size() == keys.size());
+		if (cycle % 50 == 0) {
+			assert(T.IsBalanced());
+			assert(std::vector<int>(T.begin(), T.end()) == keys);
+		}
+	}
+	assert(std::vector<int>(T.begin(), T.end()) == keys);
+}
+
+std::string SavedBytes(const AVL& T, ForkJoinPool& pool) {
+	T.Save(SNAPSHOT, pool);
+	return FileBytes(SNAPSHOT);
+}
+
+// Save gathers big trees in pieces on its pool too, see CheckParallelJSON
+void CheckParallelOutput(std::mt19937_64& rng) {
+	ForkJoinPool one(1), four(4);
+	std::vector<AVL> trees;
+	trees.push_back(ManyCopies<AVL, AVLNode>(rng));
+	// one run across all of the pieces
+	std::vector<int> same(3 * TreePartition<AVLNode>::kPieceNodes, 7);
+	trees.push_back(AVL());
+	trees.back().BuildFromSorted(same.begin(), same.end());
+	for (const AVL& T : trees) {
+		CheckParallelJSON<AVL, AVLNode>(T, one, four);
+		assert(SavedBytes(T, four) == SavedBytes(T, one));
+	}
+	std::remove(SNAPSHOT);
+}
+int main() {
+
+	// C++11 random number tutorial: https://gist.github.com/PhDP/5289449
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+	// Create uniform distribution
+	std::uniform_int_distribution<int> unif(
+		std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+	std::uniform_int_distribution<int> op(0,10);
+
+	std::vector<int> sampleData, AVLSortedData;
+	sampleData.reserve(SAMPLE_SIZE);
+	AVLSortedData.reserve(SAMPLE_SIZE);
+	std::cout << "Running tests..." << std::flush;
+	// forks, so before any pool has started threads
+	CheckSnapshotFile();
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		AVL T;
+		// On size_t usage here: https://stackoverflow.com/questions/131803/unsigned-int-vs-size-t
+		for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+			if (op(rng) == 0 && !T.empty()) {
+				T.Delete(sampleData.back());
+				sampleData.pop_back();
+			} else {			
+				// Add random integer to array
+				int x = unif(rng);
+				T.Insert(x);
+				sampleData.push_back(x);
+			}
+		}
+		assert(T.IsBalanced());
+		std::sort(sampleData.begin(), sampleData.end());
+		std::vector<int> probes(sampleData);
+		for (size_t i = 0; i < SAMPLE_SIZE / 4; i++) {
+			probes.push_back(unif(rng));
+		}
+		std::unique_ptr<bool[]> found(new bool[probes.size()]);
+		T.FindMany(probes.data(), probes.size(), found.get());
+		for (size_t i = 0; i < probes.size(); i++) {
+			assert(found[i] == T.Find(probes[i]));
+		}
+		FrozenAVL frozen = T.Freeze();
+		assert(frozen.Keys() == sampleData);
+		for (size_t i = 0; i < probes.size(); i++) {
+			int bound;
+			auto it = std::lower_bound(sampleData.begin(), sampleData.end(), probes[i]);
+			assert(frozen.LowerBound(probes[i], &bound) == (it != sampleData.end()));
+			assert(it == sampleData.end() || bound == *it);
+			assert(frozen.Find(probes[i]) == found[i]);
+		}
+		// full iteration both ways, and the bounds against <algorithm>
+		assert(std::vector<int>(T.begin(), T.end()) == sampleData);
+		assert(std::vector<int>(std::reverse_iterator<AVL::const_iterator>(T.end()),
+			std::reverse_iterator<AVL::const_iterator>(T.begin())) ==
+			std::vector<int>(sampleData.rbegin(), sampleData.rend()));
+		for (size_t i = 0; i < probes.size(); i++) {
+			auto lower = std::lower_bound(sampleData.begin(), sampleData.end(), probes[i]);
+			auto upper = std::upper_bound(sampleData.begin(), sampleData.end(), probes[i]);
+			AVL::const_iterator it = T.lower_bound(probes[i]);
+			assert((it == T.end()) == (lower == sampleData.end()));
+			assert(it == T.end() || *it == *lower);
+			it = T.upper_bound(probes[i]);
+			assert((it == T.end()) == (upper == sampleData.end()));
+			assert(it == T.end() || *it == *upper);
+			std::pair<AVL::const_iterator, AVL::const_iterator> range = T.equal_range(probes[i]);
+			assert(static_cast<ptrdiff_t>(std::distance(range.first, range.second)) == upper - lower);
+		}
+		if (sample % 100 == 0) {
+			// vector iterators and pointers are read in place, a list is
+			// copied first
+			AVL built;
+			built.BuildFromSorted(sampleData.begin(), sampleData.end());
+			assert(built.IsBalanced());
+			assert(built.size() == sampleData.size());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			built.BuildFromSorted(sampleData.data(), sampleData.data() + sampleData.size());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			std::list<int> listed(sampleData.begin(), sampleData.end());
+			built.BuildFromSorted(listed.begin(), listed.end());
+			assert(built.IsBalanced());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			std::vector<int> shuffled(probes);
+			std::vector<int> distinct(shuffled);
+			std::sort(distinct.begin(), distinct.end());
+			distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+			std::shuffle(shuffled.begin(), shuffled.end(), rng);
+			built.Build(shuffled.begin(), shuffled.end(), true);
+			assert(built.IsBalanced());
+			assert(std::vector<int>(built.begin(), built.end()) == distinct);
+			// the middle key is the root and the height is floor(log2(n))
+			nlohmann::json document = nlohmann::json::parse(built.JSON());
+			assert(document["root"].get<int>() == distinct[distinct.size() / 2]);
+			int height = 0;
+			while ((size_t(2) << height) <= distinct.size()) {
+				height++;
+			}
+			assert(JSONHeight(document, distinct[distinct.size() / 2]) == height);
+		}
+		if (sample % 10 == 0) {
+			CheckLegacyJSON(rng);
+		}
+		if (sample % 200 == 0) {
+			CheckDeltas(rng);
+		}
+		if (sample % 10 == 0) {
+			// Save then Load gives back the same tree, and the mapped file
+			// answers like it
+			T.Save(SNAPSHOT);
+			AVL loaded = AVL::Load(SNAPSHOT);
+			assert(loaded.IsBalanced());
+			assert(loaded.JSON() == T.JSON());
+			MappedAVL mapped(SNAPSHOT);
+			assert(std::vector<int>(mapped.begin(), mapped.end()) == sampleData);
+			for (size_t i = 0; i < sampleData.size(); i++) {
+				assert(mapped.Select(i) == sampleData[i]);
+			}
+			for (size_t i = 0; i < probes.size(); i++) {
+				assert(mapped.Find(probes[i]) == found[i]);
+				assert(mapped.Rank(probes[i]) == T.Rank(probes[i]));
+				assert(mapped.Rank(probes[i]) == (size_t) (std::lower_bound(
+					sampleData.begin(), sampleData.end(), probes[i]) - sampleData.begin()));
+			}
+		}
+		if (sample % 100 == 0) {
+			CheckAggregates<SumMonoid>(sampleData, rng);
+			CheckAggregates<CountMonoid>(sampleData, rng);
+			CheckAggregates<MinMonoid>(sampleData, rng);
+			CheckAggregates<MaxMonoid>(sampleData, rng);
+		}
+		for (size_t i = 0; i < sampleData.size(); i++) {
+			assert(T.Select(i) == sampleData[i]);
+			assert(T.Rank(sampleData[i]) == (size_t) (std::lower_bound(
+				sampleData.begin(), sampleData.end(), sampleData[i]) - sampleData.begin()));
+		}
+		if (!sampleData.empty()) {
+			assert(T.CountRange(sampleData.front(), sampleData.back()) == sampleData.size());
+		}
+		// JSON() cannot tell copies of a key apart, so only distinct keys
+		// round-trip
+		if (sample % 10 == 0 &&
+				std::adjacent_find(sampleData.begin(), sampleData.end()) == sampleData.end()) {
+			std::string json = T.JSON();
+			assert(AVL::FromJSON(json).JSON() == json);
+		}
+		if (sample % 10 == 0 && !sampleData.empty()) {
+			// split at a key of the tree, update each half on its own pool,
+			// then join them back with and without a pivot
+			int key = sampleData[std::uniform_int_distribution<size_t>(0, sampleData.size() - 1)(rng)];
+			size_t cut = std::lower_bound(sampleData.begin(), sampleData.end(), key) - sampleData.begin();
+			AVL whole;
+			whole.BuildFromSorted(sampleData.begin(), sampleData.end());
+			std::pair<AVL, AVL> halves = whole.Split(key);
+			assert(whole.empty());
+			assert(halves.first.size() == cut && halves.second.size() == sampleData.size() - cut);
+			assert(halves.first.IsBalanced() && halves.second.IsBalanced());
+			for (size_t i = 0; i < sampleData.size(); i++) {
+				assert((i < cut ? halves.first.Select(i) : halves.second.Select(i - cut)) == sampleData[i]);
+			}
+			std::vector<int> joined(sampleData);
+			if (cut > 0) {
+				halves.first.Insert(sampleData.front());
+				joined.insert(joined.begin(), sampleData.front());
+			}
+			if (halves.second.Delete(key)) {
+				joined.erase(joined.begin() + joined.size() - (sampleData.size() - cut));
+			}
+			AVL both = AVL::Join(std::move(halves.first), key, std::move(halves.second));
+			joined.insert(std::lower_bound(joined.begin(), joined.end(), key), key);
+			assert(halves.first.empty() && halves.second.empty());
+			assert(both.IsBalanced() && both.size() == joined.size());
+			for (size_t i = 0; i < joined.size(); i++) {
+				assert(both.Select(i) == joined[i]);
+			}
+			std::pair<AVL, AVL> again = both.Split(joined[joined.size() / 3]);
+			both = AVL::Join(std::move(again.first), std::move(again.second));
+			assert(both.IsBalanced() && both.size() == joined.size());
+			assert(std::vector<int>(both.begin(), both.end()) == joined);
+		}
+		if (sample % 10 == 0) {
+			std::vector<int> distinct(sampleData);
+			distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+			CheckSetOperations(distinct, Overlapping(distinct, SAMPLE_SIZE / 2, rng), ForkJoinPool::Default());
+		}
+		while (!T.empty()) {
+			AVLSortedData.push_back(T.DeleteMin());
+			if (T.size() % 100 == 0) {
+				assert(T.IsBalanced());
+			}
+		}
+		assert(sampleData == AVLSortedData);
+		AVLSortedData.clear();
+		sampleData.clear();
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+	// big enough that the set operations fork, on four threads whatever
+	// the machine has
+	ForkJoinPool pool(4);
+	std::vector<int> keys = Overlapping(std::vector<int>(), 200000, rng);
+	CheckSetOperations(keys, Overlapping(keys, 100000, rng), pool);
+	CheckSetOperations(keys, Overlapping(std::vector<int>(keys.begin(), keys.begin() + 1000), 100, rng), pool);
+	CheckParallelOutput(rng);
+	CheckSplitJoinChurn(rng);
+	std::remove(SNAPSHOT);
+	std::cout << "Tests complete.\n";
+}
\ No newline at end of file
@@ -3,25 +3,62 @@
 #include <fstream>
 #include "json.hpp"
 #include "AVL.h"
+#include "BPlusTree.h"
+#include "Trace.h"
 
-int main(int argc, char** argv)
+// replays the commands on any engine with AVL's Insert/Delete/DeleteMin/JSON
+template <class Tree>
+void RunCommands(nlohmann::json& AVLCOMMANDS)
 {
-    std::string filename = argv[1]; 
-    std::ifstream commandFile (filename); 
-
-    nlohmann::json AVLCOMMANDS  = nlohmann::json::parse(commandFile);
-    //nlohmann::json OutputJSON;
-    AVL tree; 
+    Tree tree; 
 
     for(nlohmann::json::iterator  it = AVLCOMMANDS.begin(); it!= AVLCOMMANDS.end(); it ++ )
     {
         if(it.key() != "metadata")
         {
             int value = AVLCOMMANDS[it.key()]["key"]; 
-            std::cout<< value<<std::endl; 
-            tree.Insert(value);  
+            std::string operation = AVLCOMMANDS[it.key()]["operation"]; 
+            if(operation == "Insert")
+            {
+                tree.Insert(value);  
+            }
+            else if(operation == "Delete")
+            {
+                tree.Delete(value); 
+            }
+            else if(operation == "DeleteMin")
+            {
+                tree.DeleteMin(); 
+            }
         }
     }; 
-   // std::cout<<tree.JSON()<<std::endl; 
+    std::cout<<tree.JSON(); 
+}
+
+// usage: AVLcommands.exe commands.json [--engine=avl|bplus]
+// bplus prints BPlusTree's own JSON, see BPlusTree.h for what of it compares
+// with the avl output
+int main(int argc, char** argv)
+{
+    std::string filename = argv[1]; 
+    std::ifstream commandFile (filename); 
+    std::string engine = (argc > 2) ? argv[2] : "--engine=avl";
+
+    nlohmann::json AVLCOMMANDS  = nlohmann::json::parse(commandFile);
+    //nlohmann::json OutputJSON;
+    if(engine == "--engine=avl")
+    {
+        RunCommands<AVL>(AVLCOMMANDS);
+    }
+    else if(engine == "--engine=bplus")
+    {
+        RunCommands<BPlusTree>(AVLCOMMANDS);
+    }
+    else
+    {
+        std::cerr << "Unknown engine " << engine << ", expected --engine=avl or --engine=bplus" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    AVL_TRACE_DUMP(std::cerr); 
     return 0;
-};
\ No newline at end of file
+};
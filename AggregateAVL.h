@@ -0,0 +1,303 @@
+#ifndef AGGREGATEAVL_H
+#define AGGREGATEAVL_H
+
+// AVL tree over int keys that keeps a monoid aggregate of every subtree up
+// to date through Insert, Delete, DeleteMin and rotations, so the aggregate
+// of any key range comes back in O(log n). The monoid is a compile-time
+// policy with a value_type and three static functions:
+//
+//   static value_type Identity();
+//   static value_type Lift(int key);
+//   static value_type Combine(const value_type& a, const value_type& b);
+//
+// Combine must be associative; it is applied in key order, so it need not
+// be commutative. Plain AVL carries no aggregate and pays nothing for this:
+// both share their rotations and retrace through AVLBase.h, where the
+// aggregate is a compile-time augmentation hook.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "AVLBase.h"
+#include "NodePool.h"
+
+struct SumMonoid {
+	typedef int64_t value_type;
+	static value_type Identity() { return 0; }
+	static value_type Lift(int key) { return key; }
+	static value_type Combine(value_type a, value_type b) { return a + b; }
+};
+
+struct CountMonoid {
+	typedef size_t value_type;
+	static value_type Identity() { return 0; }
+	static value_type Lift(int) { return 1; }
+	static value_type Combine(value_type a, value_type b) { return a + b; }
+};
+
+struct MinMonoid {
+	typedef int value_type;
+	static value_type Identity() { return std::numeric_limits<int>::max(); }
+	static value_type Lift(int key) { return key; }
+	static value_type Combine(value_type a, value_type b) { return std::min(a, b); }
+};
+
+struct MaxMonoid {
+	typedef int value_type;
+	static value_type Identity() { return std::numeric_limits<int>::min(); }
+	static value_type Lift(int key) { return key; }
+	static value_type Combine(value_type a, value_type b) { return std::max(a, b); }
+};
+
+template <class Monoid>
+class AggregateAVL;
+
+template <class Monoid>
+class AggregateAVLNode {
+ public:
+ 	typedef typename Monoid::value_type value_type;
+
+ 	AggregateAVLNode(int key, AggregateAVLNode* parent) :
+ 		key_(key),
+ 		height_(0),
+ 		parent_(parent),
+ 		left_(nullptr),
+ 		right_(nullptr),
+ 		aggregate_(Monoid::Lift(key)) {}
+
+ private:
+  int key_;
+  int height_;
+  AggregateAVLNode* parent_;
+  AggregateAVLNode* left_;
+  AggregateAVLNode* right_;
+  // Monoid::Combine over the keys of this subtree in order
+  value_type aggregate_;
+
+  friend AggregateAVL<Monoid>;
+  friend AVLBase<AggregateAVL<Monoid>, AggregateAVLNode>;
+}; // class AggregateAVLNode
+
+template <class Monoid>
+class AggregateAVL : private AVLBase<AggregateAVL<Monoid>, AggregateAVLNode<Monoid> > {
+ public:
+ 	typedef typename Monoid::value_type value_type;
+
+ 	AggregateAVL();
+ 	AggregateAVL(const AggregateAVL&) = delete;
+ 	AggregateAVL& operator=(const AggregateAVL&) = delete;
+
+ 	void Insert(int key);
+ 	bool Delete(int key);
+ 	bool Find(int key) const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+ 	// Combine over every key in [lo, hi], Identity() if there is none
+ 	value_type Aggregate(int lo, int hi) const;
+ 	// Combine over the whole tree in O(1)
+ 	value_type Aggregate() const;
+
+ private:
+	typedef AggregateAVLNode<Monoid> Node;
+	static_assert(std::is_trivially_destructible<value_type>::value,
+		"aggregates live in NodePool slabs, which skip destructors");
+
+	typedef AVLBase<AggregateAVL, Node> Base;
+	using Base::root_;
+	using Base::UpdateAncestors;
+	using Base::Unlink;
+
+	static int Height(const Node* node);
+	static value_type Value(const Node* node);
+	static void FixNode(Node* node);
+	// every aggregate on the path up changes, also above where the heights
+	// settle
+	static const bool kAugmented = true;
+	static void FixAugment(Node* node);
+	// keys >= lo of node's subtree, and keys <= hi of node's subtree
+	static value_type AggregateFrom(const Node* node, int lo);
+	static value_type AggregateTo(const Node* node, int hi);
+	int DeleteMin(Node* currentNode);
+
+	size_t size_;
+	NodePool<Node> pool_;
+
+	friend Base;
+}; // class AggregateAVL
+
+template <class Monoid>
+AggregateAVL<Monoid>::AggregateAVL() : size_(0) {}
+
+template <class Monoid>
+void AggregateAVL<Monoid>::Insert(int key) {
+	Node *currentNode = root_, *lastNode = nullptr;
+	while (currentNode != nullptr) {
+		lastNode = currentNode;
+		currentNode = (key < currentNode->key_) ?
+			currentNode->left_ : currentNode->right_;
+	}
+	Node* node = pool_.Allocate(key, lastNode);
+	if (lastNode == nullptr) {
+		root_ = node;
+	} else if (key < lastNode->key_) {
+		lastNode->left_ = node;
+	} else {
+		lastNode->right_ = node;
+	}
+	size_++;
+	UpdateAncestors(lastNode);
+}
+
+template <class Monoid>
+bool AggregateAVL<Monoid>::Delete(int key) {
+	Node* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (currentNode->key_ == key) {
+			if (currentNode->left_ != nullptr && currentNode->right_ != nullptr) {
+				// copy the successor's key up before unlinking it, so the
+				// retrace from the successor sees it on the way through here
+				Node* successor = currentNode->right_;
+				while (successor->left_ != nullptr) {
+					successor = successor->left_;
+				}
+				currentNode->key_ = successor->key_;
+				currentNode = successor;
+			}
+			Unlink(currentNode);
+			pool_.Free(currentNode);
+			size_--;
+			return true;
+		}
+		currentNode = (key < currentNode->key_) ?
+			currentNode->left_ : currentNode->right_;
+	}
+	return false;
+}
+
+template <class Monoid>
+bool AggregateAVL<Monoid>::Find(int key) const {
+	Node* currentNode = root_;
+	while (currentNode != nullptr) {
+		if (currentNode->key_ == key) {
+			return true;
+		}
+		currentNode = (key < currentNode->key_) ?
+			currentNode->left_ : currentNode->right_;
+	}
+	return false;
+}
+
+template <class Monoid>
+size_t AggregateAVL<Monoid>::size() const {
+	return size_;
+}
+
+template <class Monoid>
+bool AggregateAVL<Monoid>::empty() const {
+	return size_ == 0;
+}
+
+template <class Monoid>
+int AggregateAVL<Monoid>::DeleteMin() {
+	return DeleteMin(root_);
+}
+
+template <class Monoid>
+int AggregateAVL<Monoid>::DeleteMin(Node* currentNode) {
+	Node* lastNode = nullptr;
+	while (currentNode != nullptr) {
+		lastNode = currentNode;
+		currentNode = currentNode->left_;
+	}
+	int result = lastNode->key_;
+	Unlink(lastNode);
+	pool_.Free(lastNode);
+	size_--;
+	return result;
+}
+
+template <class Monoid>
+typename AggregateAVL<Monoid>::value_type AggregateAVL<Monoid>::Aggregate(int lo, int hi) const {
+	// descend to the first node inside [lo, hi], below it the range splits
+	// into a suffix of its left subtree and a prefix of its right subtree
+	Node* currentNode = root_;
+	while (currentNode != nullptr &&
+			(currentNode->key_ < lo || hi < currentNode->key_)) {
+		currentNode = (currentNode->key_ < lo) ?
+			currentNode->right_ : currentNode->left_;
+	}
+	if (currentNode == nullptr) {
+		return Monoid::Identity();
+	}
+	return Monoid::Combine(
+		Monoid::Combine(AggregateFrom(currentNode->left_, lo),
+			Monoid::Lift(currentNode->key_)),
+		AggregateTo(currentNode->right_, hi));
+}
+
+template <class Monoid>
+typename AggregateAVL<Monoid>::value_type AggregateAVL<Monoid>::Aggregate() const {
+	return Value(root_);
+}
+
+template <class Monoid>
+typename AggregateAVL<Monoid>::value_type AggregateAVL<Monoid>::AggregateFrom(
+		const Node* node, int lo) {
+	value_type result = Monoid::Identity();
+	while (node != nullptr) {
+		if (node->key_ < lo) {
+			node = node->right_;
+		} else {
+			// node and its right subtree are all in, and come before result
+			result = Monoid::Combine(
+				Monoid::Combine(Monoid::Lift(node->key_), Value(node->right_)), result);
+			node = node->left_;
+		}
+	}
+	return result;
+}
+
+template <class Monoid>
+typename AggregateAVL<Monoid>::value_type AggregateAVL<Monoid>::AggregateTo(
+		const Node* node, int hi) {
+	value_type result = Monoid::Identity();
+	while (node != nullptr) {
+		if (hi < node->key_) {
+			node = node->left_;
+		} else {
+			result = Monoid::Combine(result,
+				Monoid::Combine(Value(node->left_), Monoid::Lift(node->key_)));
+			node = node->right_;
+		}
+	}
+	return result;
+}
+
+template <class Monoid>
+int AggregateAVL<Monoid>::Height(const Node* node) {
+	return (node == nullptr) ? -1 : node->height_;
+}
+
+template <class Monoid>
+typename AggregateAVL<Monoid>::value_type AggregateAVL<Monoid>::Value(const Node* node) {
+	return (node == nullptr) ? Monoid::Identity() : node->aggregate_;
+}
+
+template <class Monoid>
+void AggregateAVL<Monoid>::FixNode(Node* node) {
+	node->height_ = 1 + std::max(Height(node->left_), Height(node->right_));
+	FixAugment(node);
+}
+
+template <class Monoid>
+void AggregateAVL<Monoid>::FixAugment(Node* node) {
+	node->aggregate_ = Monoid::Combine(
+		Monoid::Combine(Value(node->left_), Monoid::Lift(node->key_)),
+		Value(node->right_));
+}
+
+#endif // AGGREGATEAVL_H
@@ -0,0 +1,440 @@
+#include "BPlusTree.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <immintrin.h>
+#include <iostream>
+#include <queue>
+#include <utility>
+
+#include "json.hpp"
+
+namespace {
+
+bool DetectAVX2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+const bool kHasAVX2 = DetectAVX2();
+// checked once, every node search then takes the same well-predicted branch
+bool useAVX2 = kHasAVX2;
+
+} // namespace
+
+static_assert(sizeof(BPlusNode) == 64, "the keys of a BPlusNode must fill one cache line");
+static_assert(sizeof(BPlusLeaf) == 128, "a BPlusLeaf spans two cache lines");
+static_assert(sizeof(BPlusInner) == 192, "a BPlusInner spans three cache lines");
+
+BPlusNode::BPlusNode() : count_(0) {
+	std::fill(keys_, keys_ + kMaxKeys, INT_MAX);
+}
+
+BPlusLeaf::BPlusLeaf() {
+	std::fill(copies_, copies_ + kMaxKeys, 0);
+}
+
+BPlusInner::BPlusInner() {
+	std::fill(children_, children_ + kMaxKeys + 1, nullptr);
+}
+
+BPlusTree::BPlusTree() : height_(0), size_(0) {
+	root_ = leaves_.Allocate();
+}
+
+void BPlusTree::Insert(int key) {
+	Path path;
+	BPlusLeaf* leaf = Descend(key, &path);
+	int position = CountLess(leaf, key);
+	size_++;
+	if (position < leaf->count_ && leaf->keys_[position] == key) {
+		leaf->copies_[position]++;
+		return;
+	}
+	if (leaf->count_ < kMaxKeys) {
+		for (int i = leaf->count_; i > position; i--) {
+			leaf->keys_[i] = leaf->keys_[i - 1];
+			leaf->copies_[i] = leaf->copies_[i - 1];
+		}
+		leaf->keys_[position] = key;
+		leaf->copies_[position] = 1;
+		leaf->count_++;
+		return;
+	}
+	// full: lay out all 16 keys in order and deal them out over two leaves
+	int keys[kMaxKeys + 1];
+	uint32_t copies[kMaxKeys + 1];
+	for (int i = 0, j = 0; i <= kMaxKeys; i++) {
+		if (i == position) {
+			keys[i] = key;
+			copies[i] = 1;
+		} else {
+			keys[i] = leaf->keys_[j];
+			copies[i] = leaf->copies_[j++];
+		}
+	}
+	BPlusLeaf* right = leaves_.Allocate();
+	int half = (kMaxKeys + 1) / 2;
+	for (int i = 0; i <= kMaxKeys; i++) {
+		BPlusLeaf* target = (i < half) ? leaf : right;
+		int slot = (i < half) ? i : i - half;
+		target->keys_[slot] = keys[i];
+		target->copies_[slot] = copies[i];
+	}
+	for (int i = half; i < kMaxKeys; i++) {
+		leaf->keys_[i] = INT_MAX;
+		leaf->copies_[i] = 0;
+	}
+	leaf->count_ = half;
+	right->count_ = kMaxKeys + 1 - half;
+	InsertSeparator(&path, height_ - 1, right->keys_[0], right);
+}
+
+bool BPlusTree::Delete(int key) {
+	Path path;
+	BPlusLeaf* leaf = Descend(key, &path);
+	int position = CountLess(leaf, key);
+	if (position == leaf->count_ || leaf->keys_[position] != key) {
+		return false;
+	}
+	RemoveAt(leaf, position, &path);
+	return true;
+}
+
+bool BPlusTree::Find(int key) const {
+	const BPlusLeaf* leaf = Descend(key, nullptr);
+	int position = CountLess(leaf, key);
+	return position < leaf->count_ && leaf->keys_[position] == key;
+}
+
+std::string BPlusTree::JSON() const {
+	// nodes are listed breadth first, children refer to them by index
+	nlohmann::json result;
+	std::queue< std::pair<const BPlusNode*, int> > nodes;
+	nodes.push(std::make_pair(root_, height_));
+	int nextIndex = 1;
+	result["nodes"] = nlohmann::json::array();
+	while (!nodes.empty()) {
+		const BPlusNode* node = nodes.front().first;
+		int level = nodes.front().second;
+		nodes.pop();
+		nlohmann::json entry;
+		entry["keys"] = nlohmann::json::array();
+		if (level == 0) {
+			const BPlusLeaf* leaf = static_cast<const BPlusLeaf*>(node);
+			for (int i = 0; i < leaf->count_; i++) {
+				for (uint32_t copy = 0; copy < leaf->copies_[i]; copy++) {
+					entry["keys"].push_back(leaf->keys_[i]);
+				}
+			}
+		} else {
+			const BPlusInner* inner = static_cast<const BPlusInner*>(node);
+			entry["children"] = nlohmann::json::array();
+			for (int i = 0; i <= inner->count_; i++) {
+				if (i < inner->count_) {
+					entry["keys"].push_back(inner->keys_[i]);
+				}
+				entry["children"].push_back(nextIndex++);
+				nodes.push(std::make_pair(inner->children_[i], level - 1));
+			}
+		}
+		result["nodes"].push_back(entry);
+	}
+	result["height"] = height_;
+	result["size"] = size_;
+	return result.dump(2) + "\n";
+}
+
+size_t BPlusTree::size() const {
+	return size_;
+}
+
+bool BPlusTree::empty() const {
+	return size_ == 0;
+}
+
+int BPlusTree::DeleteMin() {
+	if (size_ == 0) {
+		std::cerr << "DeleteMin called on an empty BPlusTree" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	Path path;
+	BPlusNode* node = root_;
+	for (int depth = 0; depth < height_; depth++) {
+		path.nodes[depth] = static_cast<BPlusInner*>(node);
+		path.children[depth] = 0;
+		node = path.nodes[depth]->children_[0];
+	}
+	BPlusLeaf* leaf = static_cast<BPlusLeaf*>(node);
+	int result = leaf->keys_[0];
+	RemoveAt(leaf, 0, &path);
+	return result;
+}
+
+bool BPlusTree::UseAVX2(bool enabled) {
+	useAVX2 = enabled && kHasAVX2;
+	return useAVX2;
+}
+
+int BPlusTree::CountLess(const BPlusNode* node, int key) {
+	return useAVX2 ? CountLessAVX2(node, key) : CountLessScalar(node, key);
+}
+
+int BPlusTree::CountLessEqual(const BPlusNode* node, int key) {
+	return useAVX2 ? CountLessEqualAVX2(node, key) : CountLessEqualScalar(node, key);
+}
+
+int BPlusTree::CountLessScalar(const BPlusNode* node, int key) {
+	// the INT_MAX padding is never < key, so no need to stop at count_
+	int count = 0;
+	for (int i = 0; i < kMaxKeys; i++) {
+		count += (node->keys_[i] < key);
+	}
+	return count;
+}
+
+int BPlusTree::CountLessEqualScalar(const BPlusNode* node, int key) {
+	int count = 0;
+	for (int i = 0; i < kMaxKeys; i++) {
+		count += (node->keys_[i] <= key);
+	}
+	// the padding does count when key is INT_MAX
+	return std::min(count, node->count_);
+}
+
+__attribute__((target("avx2,popcnt")))
+int BPlusTree::CountLessAVX2(const BPlusNode* node, int key) {
+	__m256i needle = _mm256_set1_epi32(key);
+	const __m256i* line = reinterpret_cast<const __m256i*>(node->keys_);
+	int low = _mm256_movemask_ps(_mm256_castsi256_ps(
+		_mm256_cmpgt_epi32(needle, _mm256_load_si256(line))));
+	int high = _mm256_movemask_ps(_mm256_castsi256_ps(
+		_mm256_cmpgt_epi32(needle, _mm256_load_si256(line + 1))));
+	// lane 15 is count_, not a key
+	return __builtin_popcount((low | high << 8) & 0x7fff);
+}
+
+__attribute__((target("avx2,popcnt")))
+int BPlusTree::CountLessEqualAVX2(const BPlusNode* node, int key) {
+	__m256i needle = _mm256_set1_epi32(key);
+	const __m256i* line = reinterpret_cast<const __m256i*>(node->keys_);
+	int low = _mm256_movemask_ps(_mm256_castsi256_ps(
+		_mm256_cmpgt_epi32(_mm256_load_si256(line), needle)));
+	int high = _mm256_movemask_ps(_mm256_castsi256_ps(
+		_mm256_cmpgt_epi32(_mm256_load_si256(line + 1), needle)));
+	int count = __builtin_popcount(~(low | high << 8) & 0x7fff);
+	return std::min(count, node->count_);
+}
+
+BPlusLeaf* BPlusTree::Descend(int key, Path* path) const {
+	BPlusNode* node = root_;
+	for (int depth = 0; depth < height_; depth++) {
+		BPlusInner* inner = static_cast<BPlusInner*>(node);
+		int child = CountLessEqual(inner, key);
+		if (path != nullptr) {
+			path->nodes[depth] = inner;
+			path->children[depth] = child;
+		}
+		node = inner->children_[child];
+	}
+	return static_cast<BPlusLeaf*>(node);
+}
+
+void BPlusTree::RemoveAt(BPlusLeaf* leaf, int position, Path* path) {
+	size_--;
+	if (leaf->copies_[position] > 1) {
+		leaf->copies_[position]--;
+		return;
+	}
+	// separators equal to the removed key stay valid, they only have to
+	// lie between the keys of their two children
+	for (int i = position + 1; i < leaf->count_; i++) {
+		leaf->keys_[i - 1] = leaf->keys_[i];
+		leaf->copies_[i - 1] = leaf->copies_[i];
+	}
+	leaf->count_--;
+	leaf->keys_[leaf->count_] = INT_MAX;
+	leaf->copies_[leaf->count_] = 0;
+	if (height_ > 0 && leaf->count_ < kMinKeys) {
+		FixUnderflow(path, height_ - 1);
+	}
+}
+
+void BPlusTree::InsertSeparator(Path* path, int depth, int separator, BPlusNode* right) {
+	while (depth >= 0) {
+		BPlusInner* node = path->nodes[depth];
+		int child = path->children[depth];
+		if (node->count_ < kMaxKeys) {
+			for (int i = node->count_; i > child; i--) {
+				node->keys_[i] = node->keys_[i - 1];
+				node->children_[i + 1] = node->children_[i];
+			}
+			node->keys_[child] = separator;
+			node->children_[child + 1] = right;
+			node->count_++;
+			return;
+		}
+		// full: 16 separators and 17 children, the middle separator moves up
+		int keys[kMaxKeys + 1];
+		BPlusNode* children[kMaxKeys + 2];
+		children[0] = node->children_[0];
+		for (int i = 0, j = 0; i <= kMaxKeys; i++) {
+			if (i == child) {
+				keys[i] = separator;
+				children[i + 1] = right;
+			} else {
+				keys[i] = node->keys_[j];
+				children[i + 1] = node->children_[++j];
+			}
+		}
+		BPlusInner* sibling = inners_.Allocate();
+		int half = (kMaxKeys + 1) / 2;
+		for (int i = 0; i < half; i++) {
+			node->keys_[i] = keys[i];
+			node->children_[i] = children[i];
+		}
+		node->children_[half] = children[half];
+		for (int i = half; i < kMaxKeys; i++) {
+			node->keys_[i] = INT_MAX;
+			node->children_[i + 1] = nullptr;
+		}
+		node->count_ = half;
+		for (int i = half + 1; i <= kMaxKeys; i++) {
+			sibling->keys_[i - half - 1] = keys[i];
+			sibling->children_[i - half - 1] = children[i];
+		}
+		sibling->children_[kMaxKeys - half] = children[kMaxKeys + 1];
+		sibling->count_ = kMaxKeys - half;
+		separator = keys[half];
+		right = sibling;
+		depth--;
+	}
+	// the root itself split, grow a new one above it
+	BPlusInner* root = inners_.Allocate();
+	root->keys_[0] = separator;
+	root->children_[0] = root_;
+	root->children_[1] = right;
+	root->count_ = 1;
+	root_ = root;
+	height_++;
+}
+
+void BPlusTree::FixUnderflow(Path* path, int depth) {
+	while (true) {
+		BPlusInner* parent = path->nodes[depth];
+		int child = path->children[depth];
+		bool leaves = (depth == height_ - 1);
+		// the separator between left and right is parent->keys_[index]
+		int index = (child > 0) ? child - 1 : 0;
+		BPlusNode* left = parent->children_[index];
+		BPlusNode* right = parent->children_[index + 1];
+		BPlusNode* sibling = (index == child) ? right : left;
+		if (sibling->count_ > kMinKeys) {
+			if (leaves) {
+				BPlusLeaf* leftLeaf = static_cast<BPlusLeaf*>(left);
+				BPlusLeaf* rightLeaf = static_cast<BPlusLeaf*>(right);
+				if (sibling == right) {
+					leftLeaf->keys_[leftLeaf->count_] = rightLeaf->keys_[0];
+					leftLeaf->copies_[leftLeaf->count_] = rightLeaf->copies_[0];
+					leftLeaf->count_++;
+					for (int i = 1; i < rightLeaf->count_; i++) {
+						rightLeaf->keys_[i - 1] = rightLeaf->keys_[i];
+						rightLeaf->copies_[i - 1] = rightLeaf->copies_[i];
+					}
+					rightLeaf->count_--;
+					rightLeaf->keys_[rightLeaf->count_] = INT_MAX;
+					rightLeaf->copies_[rightLeaf->count_] = 0;
+				} else {
+					for (int i = rightLeaf->count_; i > 0; i--) {
+						rightLeaf->keys_[i] = rightLeaf->keys_[i - 1];
+						rightLeaf->copies_[i] = rightLeaf->copies_[i - 1];
+					}
+					leftLeaf->count_--;
+					rightLeaf->keys_[0] = leftLeaf->keys_[leftLeaf->count_];
+					rightLeaf->copies_[0] = leftLeaf->copies_[leftLeaf->count_];
+					rightLeaf->count_++;
+					leftLeaf->keys_[leftLeaf->count_] = INT_MAX;
+					leftLeaf->copies_[leftLeaf->count_] = 0;
+				}
+				parent->keys_[index] = rightLeaf->keys_[0];
+			} else {
+				// rotate through the parent's separator
+				BPlusInner* leftInner = static_cast<BPlusInner*>(left);
+				BPlusInner* rightInner = static_cast<BPlusInner*>(right);
+				if (sibling == right) {
+					leftInner->keys_[leftInner->count_] = parent->keys_[index];
+					leftInner->children_[leftInner->count_ + 1] = rightInner->children_[0];
+					leftInner->count_++;
+					parent->keys_[index] = rightInner->keys_[0];
+					for (int i = 1; i < rightInner->count_; i++) {
+						rightInner->keys_[i - 1] = rightInner->keys_[i];
+					}
+					for (int i = 1; i <= rightInner->count_; i++) {
+						rightInner->children_[i - 1] = rightInner->children_[i];
+					}
+					rightInner->count_--;
+					rightInner->keys_[rightInner->count_] = INT_MAX;
+					rightInner->children_[rightInner->count_ + 1] = nullptr;
+				} else {
+					for (int i = rightInner->count_; i > 0; i--) {
+						rightInner->keys_[i] = rightInner->keys_[i - 1];
+					}
+					for (int i = rightInner->count_ + 1; i > 0; i--) {
+						rightInner->children_[i] = rightInner->children_[i - 1];
+					}
+					rightInner->keys_[0] = parent->keys_[index];
+					rightInner->children_[0] = leftInner->children_[leftInner->count_];
+					rightInner->count_++;
+					leftInner->count_--;
+					parent->keys_[index] = leftInner->keys_[leftInner->count_];
+					leftInner->keys_[leftInner->count_] = INT_MAX;
+					leftInner->children_[leftInner->count_ + 1] = nullptr;
+				}
+			}
+			return;
+		}
+		// both are at or below the minimum, so right fits into left
+		if (leaves) {
+			BPlusLeaf* leftLeaf = static_cast<BPlusLeaf*>(left);
+			BPlusLeaf* rightLeaf = static_cast<BPlusLeaf*>(right);
+			for (int i = 0; i < rightLeaf->count_; i++) {
+				leftLeaf->keys_[leftLeaf->count_ + i] = rightLeaf->keys_[i];
+				leftLeaf->copies_[leftLeaf->count_ + i] = rightLeaf->copies_[i];
+			}
+			leftLeaf->count_ += rightLeaf->count_;
+			leaves_.Free(rightLeaf);
+		} else {
+			BPlusInner* leftInner = static_cast<BPlusInner*>(left);
+			BPlusInner* rightInner = static_cast<BPlusInner*>(right);
+			leftInner->keys_[leftInner->count_] = parent->keys_[index];
+			for (int i = 0; i < rightInner->count_; i++) {
+				leftInner->keys_[leftInner->count_ + 1 + i] = rightInner->keys_[i];
+			}
+			for (int i = 0; i <= rightInner->count_; i++) {
+				leftInner->children_[leftInner->count_ + 1 + i] = rightInner->children_[i];
+			}
+			leftInner->count_ += rightInner->count_ + 1;
+			inners_.Free(rightInner);
+		}
+		for (int i = index + 1; i < parent->count_; i++) {
+			parent->keys_[i - 1] = parent->keys_[i];
+			parent->children_[i] = parent->children_[i + 1];
+		}
+		parent->count_--;
+		parent->keys_[parent->count_] = INT_MAX;
+		parent->children_[parent->count_ + 1] = nullptr;
+		if (depth == 0) {
+			if (parent->count_ == 0) {
+				root_ = left;
+				height_--;
+				inners_.Free(parent);
+			}
+			return;
+		}
+		if (parent->count_ >= kMinKeys) {
+			return;
+		}
+		depth--;
+	}
+}
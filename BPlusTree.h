@@ -0,0 +1,119 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "NodePool.h"
+
+class BPlusTree;
+
+// The first cache line of every node: up to 15 sorted keys followed by
+// their count. Unused slots hold INT_MAX, so a search can compare all 16
+// ints at once and only has to mask off the count. Only this line is 64
+// bytes; the payload after it makes a leaf two cache lines (128 bytes) and
+// an inner node three (192 bytes). A search reads the key line and then
+// just the one copies_ or children_ entry it picked.
+class alignas(64) BPlusNode {
+ public:
+ 	static const int kMaxKeys = 15;
+
+ 	BPlusNode();
+
+ private:
+  int keys_[kMaxKeys];
+  int count_;
+
+  friend BPlusTree;
+}; // class BPlusNode
+
+// Leaves keep every key once and count duplicates beside it, so keys stay
+// strictly ordered across the whole tree.
+class BPlusLeaf : public BPlusNode {
+ public:
+ 	BPlusLeaf();
+
+ private:
+  uint32_t copies_[kMaxKeys];
+
+  friend BPlusTree;
+}; // class BPlusLeaf
+
+// children_[i] holds the keys in [keys_[i - 1], keys_[i])
+class BPlusInner : public BPlusNode {
+ public:
+ 	BPlusInner();
+
+ private:
+  BPlusNode* children_[kMaxKeys + 1];
+
+  friend BPlusTree;
+}; // class BPlusInner
+
+// Ordered multiset of ints with the same interface as AVL, stored as a
+// B+-tree whose nodes search a whole cache line of keys per level instead
+// of one key per level. On CPUs with AVX2 a node is searched with two
+// vector compares and a movemask; elsewhere with a branch-free scalar loop.
+// JSON() describes the B+-tree itself, not AVL's per-key schema, so it can
+// not be compared with AVL's output; only "size" and the keys of the leaves,
+// which are the last nodes listed and hold the multiset in order, carry over.
+class BPlusTree {
+ public:
+ 	BPlusTree();
+ 	BPlusTree(const BPlusTree&) = delete;
+ 	BPlusTree& operator=(const BPlusTree&) = delete;
+
+ 	void Insert(int key);
+ 	bool Delete(int key);
+ 	bool Find(int key) const;
+ 	std::string JSON() const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+
+ 	// for tests: searches nodes with AVX2 if enabled and the CPU has it, with
+ 	// the scalar loop otherwise; returns whether AVX2 is now in use
+ 	static bool UseAVX2(bool enabled);
+
+ private:
+	static const int kMaxKeys = BPlusNode::kMaxKeys;
+	// fewest keys a non-root node may hold, in a leaf or an inner node
+	static const int kMinKeys = kMaxKeys / 2;
+	// levels above the leaves, 2^64 keys fit in far fewer
+	static const int kMaxDepth = 32;
+
+	struct Path {
+		BPlusInner* nodes[kMaxDepth];
+		int children[kMaxDepth];
+	};
+
+	// number of keys in node < key, and <= key
+	static int CountLess(const BPlusNode* node, int key);
+	static int CountLessEqual(const BPlusNode* node, int key);
+	static int CountLessScalar(const BPlusNode* node, int key);
+	static int CountLessEqualScalar(const BPlusNode* node, int key);
+	static int CountLessAVX2(const BPlusNode* node, int key);
+	static int CountLessEqualAVX2(const BPlusNode* node, int key);
+
+	// walks from the root to the leaf that holds key, or would, recording
+	// the inner nodes and child indices taken on the way
+	BPlusLeaf* Descend(int key, Path* path) const;
+	// removes one copy of leaf->keys_[position] and repairs underflow
+	void RemoveAt(BPlusLeaf* leaf, int position, Path* path);
+	// inserts separator and the node right of it at index child + 1 of
+	// path->nodes[depth], splitting upwards as needed
+	void InsertSeparator(Path* path, int depth, int separator, BPlusNode* right);
+	// refills node, path->children[depth] of path->nodes[depth], from a
+	// sibling or merges it with one
+	void FixUnderflow(Path* path, int depth);
+
+	BPlusNode* root_;
+	// number of inner levels, 0 while the root is a leaf
+	int height_;
+	size_t size_;
+	NodePool<BPlusLeaf> leaves_;
+	NodePool<BPlusInner> inners_;
+}; // class BPlusTree
+
+#endif // BPLUSTREE_H
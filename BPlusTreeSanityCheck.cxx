@@ -0,0 +1,111 @@
+#include <cassert>
+#include <climits>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "BPlusTree.h"
+#include "json.hpp"
+
+#define SAMPLE_SIZE 2000
+#define NUM_TESTS 400
+
+// walks T.JSON(): every non-root node holds at least half a node of
+// distinct keys, and the leaves, listed last, hold model in order
+void CheckShape(const BPlusTree& T, const std::multiset<int>& model) {
+	nlohmann::json tree = nlohmann::json::parse(T.JSON());
+	assert(tree["size"] == model.size());
+	const nlohmann::json& nodes = tree["nodes"];
+	std::vector<int> keys;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const nlohmann::json& node = nodes[i];
+		std::set<int> distinct(node["keys"].begin(), node["keys"].end());
+		assert(i == 0 || distinct.size() >= 7);
+		if (node.count("children") != 0) {
+			assert(node["children"].size() == node["keys"].size() + 1);
+			assert(keys.empty());
+		} else {
+			keys.insert(keys.end(), node["keys"].begin(), node["keys"].end());
+		}
+	}
+	assert(std::vector<int>(model.begin(), model.end()) == keys);
+}
+
+void RunTests(std::mt19937_64& rng) {
+	// small range, so keys repeat and deletes hit
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE / 2);
+	std::uniform_int_distribution<int> op(0, 7);
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		BPlusTree T;
+		std::multiset<int> model;
+		// fill to a few levels, then drain by mixed updates so leaves and
+		// inner nodes underflow, borrow and merge
+		for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+			int x = unif(rng);
+			T.Insert(x);
+			model.insert(x);
+		}
+		for (size_t i = 0; i < 2 * SAMPLE_SIZE; i++) {
+			int x = unif(rng);
+			switch (op(rng)) {
+			case 0:
+				// the INT_MAX padding must never pass for a key
+				x = (x % 2 == 0) ? INT_MAX : INT_MIN;
+				T.Insert(x);
+				model.insert(x);
+				break;
+			case 1:
+				T.Insert(x);
+				model.insert(x);
+				break;
+			case 2:
+			case 3:
+				if (!model.empty()) {
+					assert(T.DeleteMin() == *model.begin());
+					model.erase(model.begin());
+				}
+				break;
+			default: {
+				bool deleted = T.Delete(x);
+				assert(deleted == (model.count(x) != 0));
+				if (deleted) {
+					model.erase(model.find(x));
+				}
+			}
+			}
+			assert(T.Find(x) == (model.count(x) != 0));
+			assert(T.Find(INT_MAX) == (model.count(INT_MAX) != 0));
+			assert(T.size() == model.size());
+		}
+		if (sample % 10 == 0) {
+			CheckShape(T, model);
+		}
+		while (!T.empty()) {
+			assert(T.DeleteMin() == *model.begin());
+			model.erase(model.begin());
+		}
+		assert(model.empty());
+		CheckShape(T, model);
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+}
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+
+	std::cout << "Running tests..." << std::flush;
+	// both node searches, the AVX2 one only where the CPU has it
+	BPlusTree::UseAVX2(false);
+	RunTests(rng);
+	if (BPlusTree::UseAVX2(true)) {
+		RunTests(rng);
+	} else {
+		std::cout << " (no AVX2)" << std::flush;
+	}
+	std::cout << "Tests complete.\n";
+}
@@ -1,21 +1,25 @@
 #include "BST.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <string>
-#include <queue>
+#include <sstream>
 
-#include "json.hpp"
+#include "JSONReader.h"
+#include "JSONWriter.h"
 
 
 BSTNode::BSTNode(int key) :
 	key_(key),
-	parent_(std::weak_ptr<BSTNode>()),
+	change_(0),
+	parent_(nullptr),
 	left_(nullptr),
 	right_(nullptr) {}
 
-BSTNode::BSTNode(int key, std::weak_ptr<BSTNode> parent) :
+BSTNode::BSTNode(int key, BSTNode* parent) :
 	key_(key),
+	change_(0),
 	parent_(parent),
 	left_(nullptr),
 	right_(nullptr) {}
@@ -32,7 +36,7 @@ bool BSTNode::HasRightChild() const {
 	return right_ != nullptr;
 }
 
-void BSTNode::DeleteChild(std::shared_ptr<BSTNode> v) {
+void BSTNode::DeleteChild(BSTNode* v) {
 	if (left_ == v) {
 		left_ = nullptr;
 	} else if (right_ == v) {
@@ -43,7 +47,7 @@ void BSTNode::DeleteChild(std::shared_ptr<BSTNode> v) {
 	}
 }
 
-void BSTNode::ReplaceChild(std::shared_ptr<BSTNode> v, std::shared_ptr<BSTNode> u) {
+void BSTNode::ReplaceChild(BSTNode* v, BSTNode* u) {
 	if (left_ == u || right_ == u) {
 		std::cerr << "BSTNode::ReplaceChild Error: child passed as replacement\n";
 	}
@@ -61,46 +65,93 @@ void BSTNode::ReplaceChild(std::shared_ptr<BSTNode> v, std::shared_ptr<BSTNode>
 
 BST::BST() : root_(nullptr), size_(0) {}
 
+BST::BST(BST&& other) :
+	root_(other.root_),
+	size_(other.size_),
+	pool_(std::move(other.pool_)),
+	changes_(std::move(other.changes_)) {
+	other.root_ = nullptr;
+	other.size_ = 0;
+}
+
+BST& BST::operator=(BST&& other) {
+	if (this != &other) {
+		pool_ = std::move(other.pool_);
+		root_ = other.root_;
+		size_ = other.size_;
+		// whoever follows this tree's deltas has not seen other's nodes
+		changes_ = std::move(other.changes_);
+		changes_.Reset();
+		other.root_ = nullptr;
+		other.size_ = 0;
+	}
+	return *this;
+}
+
 void BST::Insert(int key) {
 	if (root_ == nullptr) {
-		root_ = std::make_shared<BSTNode>(key);
+		root_ = pool_.Allocate(key);
+		changes_.Created(root_);
 		size_++;
 		return;
 	}
-	std::shared_ptr<BSTNode> currentNode = root_, lastNode = nullptr;
+	BSTNode *currentNode = root_, *lastNode = nullptr;
 	while (currentNode != nullptr) {
 		lastNode = currentNode;
 		currentNode = (key < currentNode->key_) ?
 			currentNode->left_ : currentNode->right_;
 	}
+	BSTNode* node = pool_.Allocate(key, lastNode);
 	if (key < lastNode->key_) {
-		lastNode->left_ = std::make_shared<BSTNode>(key, lastNode);
+		lastNode->left_ = node;
 	} else {
-		lastNode->right_ = std::make_shared<BSTNode>(key, lastNode);
+		lastNode->right_ = node;
 	}
+	changes_.Created(node);
+	changes_.Modified(lastNode);
 	size_++;
 	//RIGHT HERE IS WHERE WE ADD
 }
 
 bool BST::Delete(int key) {
-	std::shared_ptr<BSTNode> currentNode = root_;
+	BSTNode* currentNode = root_;
 	while (currentNode != nullptr) {
 		if (currentNode->key_ == key) {
 			if (currentNode->IsLeaf()) {
+				changes_.Modified(currentNode->parent_);
+				changes_.Removed(currentNode);
 				DeleteLeaf(currentNode);
-			} else if (currentNode->left_ == nullptr) {
-				assert(currentNode->right_ != nullptr);
-				std::shared_ptr<BSTNode> parent = currentNode->parent_.lock();
-				parent->ReplaceChild(currentNode, currentNode->right_);
-				size_--; assert(size_ >= 0);
-			} else if (currentNode->right_ == nullptr) {
-				assert(currentNode->left_ != nullptr);
-				std::shared_ptr<BSTNode> parent = currentNode->parent_.lock();
-				parent->ReplaceChild(currentNode, currentNode->left_);
+				pool_.Free(currentNode);
+			} else if (currentNode->left_ == nullptr || currentNode->right_ == nullptr) {
+				BSTNode* child = (currentNode->left_ != nullptr) ?
+					currentNode->left_ : currentNode->right_;
+				BSTNode* parent = currentNode->parent_;
+				if (parent == nullptr) {
+					root_ = child;
+					child->parent_ = nullptr;
+				} else {
+					parent->ReplaceChild(currentNode, child);
+				}
+				changes_.Modified(parent);
+				changes_.Modified(child);
+				changes_.Removed(currentNode);
+				pool_.Free(currentNode);
 				size_--; assert(size_ >= 0);
 			} else {
-				currentNode->key_ = DeleteMin(currentNode);
+				// the in-order successor has no left child, so it is the
+				// node that actually gets unlinked
+				BSTNode* successor = ExtractMin(currentNode->right_);
+				changes_.KeyMoved(successor, currentNode);
+				// their entries name currentNode by its key
+				changes_.Modified(currentNode->parent_);
+				changes_.Modified(currentNode->left_);
+				changes_.Modified(currentNode->right_);
+				currentNode->key_ = successor->key_;
+				pool_.Free(successor);
+				size_--; assert(size_ >= 0);
 			}
+			// stop here, the matched node may already be back in pool_
+			return true;
 		}
 		currentNode = (key < currentNode->key_) ?
 			currentNode->left_ : currentNode->right_;
@@ -113,8 +164,8 @@ int BST::DeleteMin() {
 }
 
 
-void BST::DeleteLeaf(std::shared_ptr<BSTNode> currentNode) {
-	std::shared_ptr<BSTNode> parent = currentNode->parent_.lock();
+void BST::DeleteLeaf(BSTNode* currentNode) {
+	BSTNode* parent = currentNode->parent_;
 	if (parent == nullptr) {
 		// Delete root
 		root_ = nullptr;
@@ -131,32 +182,105 @@ void BST::DeleteLeaf(std::shared_ptr<BSTNode> currentNode) {
 	}
 }
 
-int BST::DeleteMin(std::shared_ptr<BSTNode> currentNode) {
-	std::shared_ptr<BSTNode> lastNode = nullptr;
+int BST::DeleteMin(BSTNode* currentNode) {
+	BSTNode* lastNode = ExtractMin(currentNode);
+	int result = lastNode->key_;
+	changes_.Removed(lastNode);
+	pool_.Free(lastNode);
+	size_--; assert(size_ >= 0);
+	return result;
+}
+
+BSTNode* BST::ExtractMin(BSTNode* currentNode) {
+	BSTNode* lastNode = nullptr;
 	while (currentNode != nullptr) {
 		lastNode = currentNode;
 		currentNode = currentNode->left_;
 	}
-	int result = lastNode->key_;
-	std::shared_ptr<BSTNode> parent = lastNode->parent_.lock();
+	BSTNode* parent = lastNode->parent_;
 	if (parent == nullptr) {
 		// lastNode is root
 		if (lastNode->right_ != nullptr) {
 			root_ = lastNode->right_;
-			lastNode->right_->parent_.reset();
+			lastNode->right_->parent_ = nullptr;
 		} else {
 			root_ = nullptr;
 		}
 	} else {
-		// lastNode under the root
+		// lastNode under the root, it is a right child when the search
+		// started at a successor subtree
 		if (lastNode->right_ != nullptr) {
-			parent->left_ = lastNode->right_;
 			lastNode->right_->parent_ = parent;
+		}
+		if (parent->left_ == lastNode) {
+			parent->left_ = lastNode->right_;
 		} else {
-			parent->left_ = nullptr;
+			parent->right_ = lastNode->right_;
 		}
   }
-	size_--; assert(size_ >= 0);
+	changes_.Modified(parent);
+	changes_.Modified(lastNode->right_);
+	lastNode->parent_ = lastNode->right_ = nullptr;
+	return lastNode;
+}
+
+void BST::ClearForBuild(size_t n) {
+	changes_.Reset();
+	pool_.Clear();
+	pool_.Reserve(n);
+}
+
+BST::const_iterator BST::begin() const {
+	return const_iterator(const_iterator::Leftmost(root_), &root_);
+}
+
+BST::const_iterator BST::end() const {
+	return const_iterator(nullptr, &root_);
+}
+
+BST::const_iterator BST::lower_bound(int key) const {
+	BSTNode *currentNode = root_, *result = nullptr;
+	while (currentNode != nullptr) {
+		if (currentNode->key_ < key) {
+			currentNode = currentNode->right_;
+		} else {
+			result = currentNode;
+			currentNode = currentNode->left_;
+		}
+	}
+	return const_iterator(result, &root_);
+}
+
+BST::const_iterator BST::upper_bound(int key) const {
+	BSTNode *currentNode = root_, *result = nullptr;
+	while (currentNode != nullptr) {
+		if (key < currentNode->key_) {
+			result = currentNode;
+			currentNode = currentNode->left_;
+		} else {
+			currentNode = currentNode->right_;
+		}
+	}
+	return const_iterator(result, &root_);
+}
+
+std::pair<BST::const_iterator, BST::const_iterator> BST::equal_range(int key) const {
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+BST BST::FromJSON(std::istream& in) {
+	BST result;
+	JSONReader reader(in);
+	result.changes_.Reset();
+	result.root_ = reader.ReadTree<BSTNode>(result.pool_, &result.size_);
+	return result;
+}
+
+BST BST::FromJSON(const std::string& document) {
+	BST result;
+	JSONReader reader(document);
+	result.changes_.Reset();
+	result.root_ = reader.ReadTree<BSTNode>(result.pool_, &result.size_);
 	return result;
 }
 
@@ -169,7 +293,7 @@ bool BST::empty() const {
 }
 
 bool BST::Find(int key) const {
-	std::shared_ptr<BSTNode> currentNode = root_;
+	BSTNode* currentNode = root_;
 	while (currentNode != nullptr) {
 		if (currentNode->key_ == key) {
 			return true;
@@ -180,31 +304,42 @@ bool BST::Find(int key) const {
 	return false;
 }
 
-std::string BST::JSON() const {
-	nlohmann::json result;
-	std::queue< std::shared_ptr<BSTNode> > nodes;
-	if (root_ != nullptr) {
-		result["root"] = root_->key_;
-		nodes.push(root_);
-		while (!nodes.empty()) {
-			auto v = nodes.front();
-			nodes.pop();
-			std::string key = std::to_string(v->key_);
-			if (v->left_ != nullptr) {
-				result[key]["left"] = v->left_->key_;
-				nodes.push(v->left_);
-			}
-			if (v->right_ != nullptr) {
-				result[key]["right"] = v->right_->key_;
-				nodes.push(v->right_);
-			}
-			if (v->parent_.lock() != nullptr) {
-				result[key]["parent"] = v->parent_.lock()->key_;
-			} else {
-				result[key]["root"] = true;
-			}
-		}
-	}
-	result["size"] = size_;
-	return result.dump(2) + "\n";
+std::string BST::JSON(ForkJoinPool& pool) const {
+	std::ostringstream out;
+	WriteJSON(out, false, pool);
+	return out.str();
+}
+
+void BST::WriteJSON(std::ostream& out, bool compact, ForkJoinPool& pool) const {
+	JSONWriter writer(out, compact);
+	writer.WriteTree(root_, size_, pool);
+}
+
+void BST::WriteJSON(int fd, bool compact, ForkJoinPool& pool) const {
+	JSONWriter writer(fd, compact);
+	writer.WriteTree(root_, size_, pool);
+}
+
+std::string BST::JSONDelta() {
+	std::ostringstream out;
+	WriteJSONDelta(out);
+	return out.str();
+}
+
+void BST::WriteJSONDelta(std::ostream& out, bool compact) {
+	JSONWriter writer(out, compact);
+	WriteDelta(writer);
+}
+
+void BST::WriteJSONDelta(int fd, bool compact) {
+	JSONWriter writer(fd, compact);
+	WriteDelta(writer);
+}
+
+void BST::WriteDelta(JSONWriter& writer) {
+	std::vector<const BSTNode*> created, modified;
+	std::vector<int> removed, vanished;
+	bool reset;
+	changes_.TakeChanges(&created, &modified, &removed, &vanished, &reset);
+	writer.WriteDelta(root_, size_, reset, created, modified, removed, vanished);
 }
@@ -1,44 +1,166 @@
-#include <memory>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iosfwd>
+#include <iterator>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "ChangeLog.h"
+#include "ForkJoinPool.h"
+#include "NodePool.h"
+#include "TreeIterator.h"
 
 class BST;
+class JSONReader;
+class JSONWriter;
+template <class Node>
+class TreePartition;
 
 class BSTNode {
  public:
  	BSTNode(int key);
- 	BSTNode(int key, std::weak_ptr<BSTNode> parent);
+ 	BSTNode(int key, BSTNode* parent);
  	bool IsLeaf() const;
  	bool IsMissingChild() const;
  	bool HasLeftChild() const;
  	bool HasRightChild() const;
- 	void DeleteChild(std::shared_ptr<BSTNode> v);
- 	void ReplaceChild(std::shared_ptr<BSTNode> v, std::shared_ptr<BSTNode> u);
+ 	void DeleteChild(BSTNode* v);
+ 	void ReplaceChild(BSTNode* v, BSTNode* u);
 
  private:
   int key_;
-  std::weak_ptr<BSTNode> parent_;
-  std::shared_ptr<BSTNode> left_;
-  std::shared_ptr<BSTNode> right_;
+  // slot in the tree's ChangeLog, see ChangeLog.h
+  uint32_t change_;
+  BSTNode* parent_;
+  BSTNode* left_;
+  BSTNode* right_;
 
   friend BST;
+  friend ChangeLog<BSTNode>;
+  friend TreeIterator<BSTNode>;
+  friend JSONWriter;
+  friend JSONReader;
+  friend TreePartition<BSTNode>;
 }; // class BSTNode
 
 class BST {
  public:
  	BST();
+ 	BST(const BST&) = delete;
+ 	BST& operator=(const BST&) = delete;
+ 	BST(BST&& other);
+ 	BST& operator=(BST&& other);
+
+ 	// in-order iteration over the keys, see TreeIterator.h
+ 	typedef TreeIterator<BSTNode> const_iterator;
+ 	typedef const_iterator iterator;
+ 	const_iterator begin() const;
+ 	const_iterator end() const;
+ 	// first key >= key and first key > key, so a range scan over [lo, hi]
+ 	// costs O(log n + k) and allocates nothing
+ 	const_iterator lower_bound(int key) const;
+ 	const_iterator upper_bound(int key) const;
+ 	std::pair<const_iterator, const_iterator> equal_range(int key) const;
 
  	void Insert(int key);
  	bool Delete(int key);
  	bool Find(int key) const;
- 	std::string JSON() const;
+ 	// big trees are rendered in pieces on pool, see JSONWriter.h; the
+ 	// output is the same for any pool
+ 	std::string JSON(ForkJoinPool& pool = ForkJoinPool::Default()) const;
+ 	// streams the same document as JSON() in key order through a fixed
+ 	// buffer, see JSONWriter.h; compact drops the whitespace
+ 	void WriteJSON(std::ostream& out, bool compact = false,
+ 		ForkJoinPool& pool = ForkJoinPool::Default()) const;
+ 	void WriteJSON(int fd, bool compact = false,
+ 		ForkJoinPool& pool = ForkJoinPool::Default()) const;
+	// what changed since the last call, as a patch against the JSON() of
+	// the tree back then, see ChangeLog.h and AVL::JSONDelta
+	std::string JSONDelta();
+	void WriteJSONDelta(std::ostream& out, bool compact = false);
+	void WriteJSONDelta(int fd, bool compact = false);
+	// rebuilds the exact tree a JSON() document describes in O(n), see
+	// JSONReader.h; exits with a message if it does not describe one
+	static BST FromJSON(std::istream& in);
+	static BST FromJSON(const std::string& document);
  	size_t size() const;
  	bool empty() const;
  	int DeleteMin();
+ 	// replaces the contents with a perfectly balanced tree over the sorted
+ 	// range [first, last) in O(n), no comparisons or rotations involved;
+ 	// random access ranges are read in place, others are copied first
+ 	template <class Iterator>
+ 	void BuildFromSorted(Iterator first, Iterator last);
+ 	// same for an arbitrary range, which is sorted (and optionally
+ 	// deduplicated) first
+ 	template <class Iterator>
+ 	void Build(Iterator first, Iterator last, bool deduplicate = false);
 
  private:
-	void DeleteLeaf(std::shared_ptr<BSTNode> currentNode);
-	int DeleteMin(std::shared_ptr<BSTNode> currentNode);
+	void DeleteLeaf(BSTNode* currentNode);
+	int DeleteMin(BSTNode* currentNode);
+	// unlinks the minimum of currentNode's subtree without freeing it
+	BSTNode* ExtractMin(BSTNode* currentNode);
+	// hands the changes since the last delta to writer and starts over
+	void WriteDelta(JSONWriter& writer);
+	template <class Iterator>
+	void BuildSorted(Iterator first, Iterator last, std::random_access_iterator_tag);
+	template <class Iterator>
+	void BuildSorted(Iterator first, Iterator last, std::input_iterator_tag);
+	// empties the tree for a build of n nodes
+	void ClearForBuild(size_t n);
+	template <class Iterator>
+	BSTNode* BuildBalanced(Iterator keys, size_t n, BSTNode* parent);
 
- 	std::shared_ptr<BSTNode> root_;
+ 	BSTNode* root_;
  	size_t size_;
-}; // class BST
\ No newline at end of file
+ 	// owns every node, ~BST releases it slab by slab without a tree walk
+ 	NodePool<BSTNode> pool_;
+ 	// nodes changed since the last JSONDelta
+ 	ChangeLog<BSTNode> changes_;
+}; // class BST
+
+template <class Iterator>
+void BST::BuildFromSorted(Iterator first, Iterator last) {
+	BuildSorted(first, last, typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+template <class Iterator>
+void BST::BuildSorted(Iterator first, Iterator last, std::random_access_iterator_tag) {
+	assert(std::is_sorted(first, last));
+	size_t n = last - first;
+	ClearForBuild(n);
+	root_ = BuildBalanced(first, n, nullptr);
+	size_ = n;
+}
+
+template <class Iterator>
+void BST::BuildSorted(Iterator first, Iterator last, std::input_iterator_tag) {
+	std::vector<int> keys(first, last);
+	BuildSorted(keys.cbegin(), keys.cend(), std::random_access_iterator_tag());
+}
+
+// recursion depth is log2(n), the halves never differ by more than one key
+template <class Iterator>
+BSTNode* BST::BuildBalanced(Iterator keys, size_t n, BSTNode* parent) {
+	if (n == 0) {
+		return nullptr;
+	}
+	size_t mid = n / 2;
+	BSTNode* node = pool_.Allocate(keys[mid], parent);
+	node->left_ = BuildBalanced(keys, mid, node);
+	node->right_ = BuildBalanced(keys + mid + 1, n - mid - 1, node);
+	return node;
+}
+
+template <class Iterator>
+void BST::Build(Iterator first, Iterator last, bool deduplicate) {
+	std::vector<int> keys(first, last);
+	std::sort(keys.begin(), keys.end());
+	if (deduplicate) {
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	}
+	BuildSorted(keys.cbegin(), keys.cend(), std::random_access_iterator_tag());
+}
@@ -1,14 +1,151 @@
 #include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <iostream>
+#include <list>
+#include <queue>
 #include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "BST.h"
+#include "SanityCheck.h"
+#include "TreePartition.h"
+#include "json.hpp"
 
 #define SAMPLE_SIZE 1000
 #define NUM_TESTS 10000
 
+// JSON() streams its members in numeric key order and merges copies of a
+// key itself, so it has to parse to the same document that nlohmann's DOM
+// built. The reference is a plain BST with the same Insert and DeleteMin,
+// whose document is built the way BST::JSON() used to build it.
+struct ReferenceBST {
+	struct Node {
+		int key;
+		int left;
+		int right;
+	};
+	std::vector<Node> nodes;
+	int root = -1;
+	size_t size = 0;
+
+	void Insert(int key) {
+		nodes.push_back(Node{key, -1, -1});
+		int* link = &root;
+		while (*link != -1) {
+			link = (key < nodes[*link].key) ? &nodes[*link].left : &nodes[*link].right;
+		}
+		*link = nodes.size() - 1;
+		size++;
+	}
+	int DeleteMin() {
+		int* link = &root;
+		while (nodes[*link].left != -1) {
+			link = &nodes[*link].left;
+		}
+		int key = nodes[*link].key;
+		*link = nodes[*link].right;
+		size--;
+		return key;
+	}
+	nlohmann::json JSON() const {
+		nlohmann::json result;
+		// (node, parent) pairs
+		std::queue< std::pair<int, int> > queue;
+		if (root != -1) {
+			result["root"] = nodes[root].key;
+			queue.push(std::make_pair(root, -1));
+			while (!queue.empty()) {
+				int index = queue.front().first;
+				int parent = queue.front().second;
+				queue.pop();
+				const Node& v = nodes[index];
+				std::string key = std::to_string(v.key);
+				if (v.left != -1) {
+					result[key]["left"] = nodes[v.left].key;
+					queue.push(std::make_pair(v.left, index));
+				}
+				if (v.right != -1) {
+					result[key]["right"] = nodes[v.right].key;
+					queue.push(std::make_pair(v.right, index));
+				}
+				if (parent != -1) {
+					result[key]["parent"] = nodes[parent].key;
+				} else {
+					result[key]["root"] = true;
+				}
+			}
+		}
+		result["size"] = size;
+		return result;
+	}
+};
+
+void CheckDeltas(std::mt19937_64& rng) {
+	BST T;
+	nlohmann::json document;
+	// a new tree has nothing to patch yet
+	assert(ApplyDelta(document, T.JSONDelta()));
+	UpdateAndPatch(T, document, rng);
+	std::vector<int> keys(T.begin(), T.end());
+	T.BuildFromSorted(keys.begin(), keys.end());
+	assert(ApplyDelta(document, T.JSONDelta()));
+	assert(document == nlohmann::json::parse(T.JSON()));
+	UpdateAndPatch(T, document, rng);
+}
+
+void CheckLegacyJSON(std::mt19937_64& rng) {
+	// small range, so keys repeat and copies land at every depth
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE / 20);
+	std::uniform_int_distribution<int> op(0, 5);
+	BST T;
+	ReferenceBST reference;
+	for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+		if (op(rng) == 0 && !T.empty()) {
+			assert(T.DeleteMin() == reference.DeleteMin());
+		} else {
+			int x = unif(rng);
+			T.Insert(x);
+			reference.Insert(x);
+		}
+	}
+	nlohmann::json document = reference.JSON();
+	assert(nlohmann::json::parse(T.JSON()) == document);
+	std::ostringstream compact;
+	T.WriteJSON(compact, true);
+	assert(nlohmann::json::parse(compact.str()) == document);
+}
+
+// a balanced tree and a degenerate one, see CheckParallelJSON
+void CheckParallelOutput(std::mt19937_64& rng) {
+	ForkJoinPool one(1), four(4);
+	std::vector<BST> trees;
+	trees.push_back(ManyCopies<BST, BSTNode>(rng));
+	// a chain leaning right, cut into single nodes and one long subtree;
+	// inserting it in order would take quadratic time, FromJSON is linear
+	int chain = static_cast<int>(3 * TreePartition<BSTNode>::kPieceNodes);
+	std::string document = "{";
+	for (int key = 0; key < chain; key++) {
+		document += "\"" + std::to_string(key) + "\":{";
+		if (key > 0) {
+			document += "\"parent\":" + std::to_string(key - 1);
+		}
+		if (key + 1 < chain) {
+			document += std::string((key > 0) ? "," : "") + "\"right\":" + std::to_string(key + 1);
+		}
+		document += (key == 0) ? ",\"root\":true}," : "},";
+	}
+	document += "\"root\":0,\"size\":" + std::to_string(chain) + "}";
+	trees.push_back(BST::FromJSON(document));
+	for (const BST& T : trees) {
+		CheckParallelJSON<BST, BSTNode>(T, one, four);
+	}
+	std::ostringstream compact;
+	trees.back().WriteJSON(compact, true, four);
+	assert(compact.str() == document + "\n");
+}
 int main() {
 
 	// C++11 random number tutorial: https://gist.github.com/PhDP/5289449
@@ -37,10 +174,72 @@ int main() {
 				sampleData.push_back(x);
 			}
 		}
+		std::sort(sampleData.begin(), sampleData.end());
+		std::vector<int> probes(sampleData);
+		for (size_t i = 0; i < SAMPLE_SIZE / 4; i++) {
+			probes.push_back(unif(rng));
+		}
+		// full iteration both ways, and the bounds against <algorithm>
+		assert(std::vector<int>(T.begin(), T.end()) == sampleData);
+		assert(std::vector<int>(std::reverse_iterator<BST::const_iterator>(T.end()),
+			std::reverse_iterator<BST::const_iterator>(T.begin())) ==
+			std::vector<int>(sampleData.rbegin(), sampleData.rend()));
+		for (size_t i = 0; i < probes.size(); i++) {
+			auto lower = std::lower_bound(sampleData.begin(), sampleData.end(), probes[i]);
+			auto upper = std::upper_bound(sampleData.begin(), sampleData.end(), probes[i]);
+			BST::const_iterator it = T.lower_bound(probes[i]);
+			assert((it == T.end()) == (lower == sampleData.end()));
+			assert(it == T.end() || *it == *lower);
+			it = T.upper_bound(probes[i]);
+			assert((it == T.end()) == (upper == sampleData.end()));
+			assert(it == T.end() || *it == *upper);
+			std::pair<BST::const_iterator, BST::const_iterator> range = T.equal_range(probes[i]);
+			assert(static_cast<ptrdiff_t>(std::distance(range.first, range.second)) == upper - lower);
+		}
+		if (sample % 10 == 0) {
+			CheckLegacyJSON(rng);
+		}
+		if (sample % 200 == 0) {
+			CheckDeltas(rng);
+		}
+		if (sample % 100 == 0) {
+			// vector iterators and pointers are read in place, a list is
+			// copied first
+			BST built;
+			built.BuildFromSorted(sampleData.begin(), sampleData.end());
+			assert(built.size() == sampleData.size());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			built.BuildFromSorted(sampleData.data(), sampleData.data() + sampleData.size());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			std::list<int> listed(sampleData.begin(), sampleData.end());
+			built.BuildFromSorted(listed.begin(), listed.end());
+			assert(std::vector<int>(built.begin(), built.end()) == sampleData);
+			std::vector<int> shuffled(sampleData);
+			std::vector<int> distinct(shuffled);
+			std::sort(distinct.begin(), distinct.end());
+			distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+			std::shuffle(shuffled.begin(), shuffled.end(), rng);
+			built.Build(shuffled.begin(), shuffled.end(), true);
+			assert(std::vector<int>(built.begin(), built.end()) == distinct);
+			// the middle key is the root and the height is floor(log2(n))
+			nlohmann::json document = nlohmann::json::parse(built.JSON());
+			assert(document["root"].get<int>() == distinct[distinct.size() / 2]);
+			int height = 0;
+			while ((size_t(2) << height) <= distinct.size()) {
+				height++;
+			}
+			assert(JSONHeight(document, distinct[distinct.size() / 2]) == height);
+		}
+		// JSON() cannot tell copies of a key apart, so only distinct keys
+		// round-trip
+		if (sample % 10 == 0 &&
+				std::adjacent_find(sampleData.begin(), sampleData.end()) == sampleData.end()) {
+			std::string json = T.JSON();
+			assert(BST::FromJSON(json).JSON() == json);
+		}
 		while (!T.empty()) {
 			BSTSortedData.push_back(T.DeleteMin());
 		}
-		std::sort(sampleData.begin(), sampleData.end());
 		assert(sampleData == BSTSortedData);
 		BSTSortedData.clear();
 		sampleData.clear();
@@ -48,5 +247,6 @@ int main() {
 			std::cout << "." << std::flush;
 		}
 	}
+	CheckParallelOutput(rng);
 	std::cout << "Tests complete.\n";
 }
\ No newline at end of file
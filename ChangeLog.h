@@ -0,0 +1,205 @@
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Which JSON() entries of a BST or AVL tree changed since the last
+// checkpoint, so JSONDelta can write just those. A node's entry names the
+// keys of its children and its parent, so it changes when one of those
+// links does, rotations included, or when a linked node takes on another
+// key; the tree reports each such node as it happens. Heights are not part
+// of an entry and are not tracked.
+//
+// Every changed node is listed once and keeps its slot in Node::change_
+// (slot + 1, 0 while unchanged), so marking it again is O(1), and a node
+// that is freed is taken off by moving the last slot into its place. Keys
+// that left the tree are listed apart, and so are the keys of nodes that
+// were created after the checkpoint and freed again: copies of such a key
+// that are left share one entry with it, which may have changed. Bulk
+// rebuilds call Reset instead, before they touch any
+// node: tracking stops and the next delta carries the whole tree. A new
+// log starts out reset, so trees that never publish a delta pay only a
+// branch per change.
+template <class Node>
+class ChangeLog {
+ public:
+	ChangeLog();
+	// the tree other belonged to starts again from a reset
+	ChangeLog(ChangeLog&& other);
+	ChangeLog& operator=(ChangeLog&& other);
+	ChangeLog(const ChangeLog&) = delete;
+	ChangeLog& operator=(const ChangeLog&) = delete;
+
+	// node's entry is not what it was at the checkpoint, null is ignored
+	void Modified(Node* node);
+	// node was just allocated for a key
+	void Created(Node* node);
+	// node is about to be freed, its key leaves the tree
+	void Removed(Node* node);
+	// to takes over the key of from, which is about to be freed, and the
+	// key to held so far leaves the tree (Delete's successor copy)
+	void KeyMoved(Node* from, Node* to);
+	void Reset();
+	// hands over the changes since the checkpoint, nodes and keys sorted by
+	// key, and makes the tree as it is now the next checkpoint; with *reset
+	// set, every node of the tree counts as created instead. vanished gets
+	// the keys of nodes created and freed since the checkpoint.
+	void TakeChanges(std::vector<const Node*>* created, std::vector<const Node*>* modified,
+		std::vector<int>* removed, std::vector<int>* vanished, bool* reset);
+
+ private:
+	struct Change {
+		Node* node;
+		// the node's key was not in the tree at the checkpoint
+		bool created;
+	};
+
+	void Add(Node* node, bool created);
+	bool IsCreated(const Node* node) const;
+	// takes node off the list if it is on it
+	void Forget(Node* node);
+
+	std::vector<Change> changes_;
+	std::vector<int> removed_;
+	std::vector<int> vanished_;
+	bool reset_;
+}; // class ChangeLog
+
+template <class Node>
+ChangeLog<Node>::ChangeLog() : reset_(true) {}
+
+template <class Node>
+ChangeLog<Node>::ChangeLog(ChangeLog&& other) :
+	changes_(std::move(other.changes_)),
+	removed_(std::move(other.removed_)),
+	vanished_(std::move(other.vanished_)),
+	reset_(other.reset_) {
+	other.changes_.clear();
+	other.removed_.clear();
+	other.vanished_.clear();
+	other.reset_ = true;
+}
+
+template <class Node>
+ChangeLog<Node>& ChangeLog<Node>::operator=(ChangeLog&& other) {
+	if (this != &other) {
+		changes_ = std::move(other.changes_);
+		removed_ = std::move(other.removed_);
+		vanished_ = std::move(other.vanished_);
+		reset_ = other.reset_;
+		other.changes_.clear();
+		other.removed_.clear();
+		other.vanished_.clear();
+		other.reset_ = true;
+	}
+	return *this;
+}
+
+template <class Node>
+void ChangeLog<Node>::Modified(Node* node) {
+	if (node != nullptr && !reset_ && node->change_ == 0) {
+		Add(node, false);
+	}
+}
+
+template <class Node>
+void ChangeLog<Node>::Created(Node* node) {
+	if (!reset_) {
+		Add(node, true);
+	}
+}
+
+template <class Node>
+void ChangeLog<Node>::Removed(Node* node) {
+	if (reset_) {
+		return;
+	}
+	(IsCreated(node) ? vanished_ : removed_).push_back(node->key_);
+	Forget(node);
+}
+
+template <class Node>
+void ChangeLog<Node>::KeyMoved(Node* from, Node* to) {
+	if (reset_) {
+		return;
+	}
+	bool created = IsCreated(from);
+	Forget(from);
+	(IsCreated(to) ? vanished_ : removed_).push_back(to->key_);
+	if (to->change_ == 0) {
+		Add(to, created);
+	} else {
+		changes_[to->change_ - 1].created = created;
+	}
+}
+
+template <class Node>
+void ChangeLog<Node>::Reset() {
+	// everything listed is still in the tree, nothing is freed before Reset
+	for (const Change& change : changes_) {
+		change.node->change_ = 0;
+	}
+	changes_.clear();
+	removed_.clear();
+	vanished_.clear();
+	reset_ = true;
+}
+
+template <class Node>
+void ChangeLog<Node>::TakeChanges(std::vector<const Node*>* created,
+		std::vector<const Node*>* modified, std::vector<int>* removed,
+		std::vector<int>* vanished, bool* reset) {
+	created->clear();
+	modified->clear();
+	for (const Change& change : changes_) {
+		change.node->change_ = 0;
+		(change.created ? created : modified)->push_back(change.node);
+	}
+	auto byKey = [](const Node* a, const Node* b) { return a->key_ < b->key_; };
+	std::sort(created->begin(), created->end(), byKey);
+	std::sort(modified->begin(), modified->end(), byKey);
+	std::sort(removed_.begin(), removed_.end());
+	std::sort(vanished_.begin(), vanished_.end());
+	removed->swap(removed_);
+	vanished->swap(vanished_);
+	*reset = reset_;
+	changes_.clear();
+	removed_.clear();
+	vanished_.clear();
+	reset_ = false;
+}
+
+template <class Node>
+void ChangeLog<Node>::Add(Node* node, bool created) {
+	// change_ has to be able to hold every slot, a log that big is
+	// cheaper to publish as a reset anyway
+	if (changes_.size() >= UINT32_MAX - 1) {
+		Reset();
+		return;
+	}
+	Change change = {node, created};
+	changes_.push_back(change);
+	node->change_ = static_cast<uint32_t>(changes_.size());
+}
+
+template <class Node>
+bool ChangeLog<Node>::IsCreated(const Node* node) const {
+	return node->change_ != 0 && changes_[node->change_ - 1].created;
+}
+
+template <class Node>
+void ChangeLog<Node>::Forget(Node* node) {
+	if (node->change_ == 0) {
+		return;
+	}
+	Change last = changes_.back();
+	changes_[node->change_ - 1] = last;
+	last.node->change_ = node->change_;
+	changes_.pop_back();
+	node->change_ = 0;
+}
+
+#endif // CHANGELOG_H
@@ -0,0 +1,249 @@
+#include "CompactAVL.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <queue>
+#include <utility>
+
+#include "json.hpp"
+
+static_assert(sizeof(CompactAVLNode) == 16, "CompactAVLNode must stay 16 bytes");
+
+const uint32_t CompactAVL::kNil;
+
+CompactAVLNode::CompactAVLNode(int key) :
+	key_(key),
+	left_(0),
+	right_(0),
+	height_(0) {}
+
+CompactAVL::CompactAVL() : root_(kNil), free_(kNil), size_(0) {
+	nodes_.push_back(CompactAVLNode(0));
+	nodes_[kNil].height_ = -1;
+}
+
+uint32_t CompactAVL::NewNode(int key) {
+	if (free_ != kNil) {
+		uint32_t node = free_;
+		free_ = nodes_[node].left_;
+		nodes_[node] = CompactAVLNode(key);
+		return node;
+	}
+	if (nodes_.size() > UINT32_MAX - 1) {
+		std::cerr << "CompactAVL::NewNode Error: out of 32-bit indices\n";
+		exit(EXIT_FAILURE);
+	}
+	nodes_.push_back(CompactAVLNode(key));
+	return nodes_.size() - 1;
+}
+
+void CompactAVL::FreeNode(uint32_t node) {
+	nodes_[node].left_ = free_;
+	free_ = node;
+}
+
+void CompactAVL::FixHeight(uint32_t node) {
+	CompactAVLNode& v = nodes_[node];
+	v.height_ = 1 + std::max(nodes_[v.left_].height_, nodes_[v.right_].height_);
+}
+
+int CompactAVL::BalanceFactor(uint32_t node) const {
+	const CompactAVLNode& v = nodes_[node];
+	return nodes_[v.right_].height_ - nodes_[v.left_].height_;
+}
+
+uint32_t CompactAVL::RotateLeft(uint32_t node) {
+	uint32_t pivot = nodes_[node].right_;
+	nodes_[node].right_ = nodes_[pivot].left_;
+	nodes_[pivot].left_ = node;
+	FixHeight(node);
+	FixHeight(pivot);
+	return pivot;
+}
+
+uint32_t CompactAVL::RotateRight(uint32_t node) {
+	uint32_t pivot = nodes_[node].left_;
+	nodes_[node].left_ = nodes_[pivot].right_;
+	nodes_[pivot].right_ = node;
+	FixHeight(node);
+	FixHeight(pivot);
+	return pivot;
+}
+
+uint32_t CompactAVL::Rebalance(uint32_t node) {
+	int balance = BalanceFactor(node);
+	if (balance > 1) {
+		if (BalanceFactor(nodes_[node].right_) < 0) {
+			nodes_[node].right_ = RotateRight(nodes_[node].right_);
+		}
+		return RotateLeft(node);
+	}
+	if (balance < -1) {
+		if (BalanceFactor(nodes_[node].left_) > 0) {
+			nodes_[node].left_ = RotateLeft(nodes_[node].left_);
+		}
+		return RotateRight(node);
+	}
+	return node;
+}
+
+void CompactAVL::Retrace(uint32_t* path, int depth) {
+	for (int i = depth - 1; i >= 0; i--) {
+		uint32_t node = path[i];
+		int oldHeight = nodes_[node].height_;
+		FixHeight(node);
+		uint32_t subtree = Rebalance(node);
+		if (subtree != node) {
+			if (i == 0) {
+				root_ = subtree;
+			} else if (nodes_[path[i - 1]].left_ == node) {
+				nodes_[path[i - 1]].left_ = subtree;
+			} else {
+				nodes_[path[i - 1]].right_ = subtree;
+			}
+		}
+		if (nodes_[subtree].height_ == oldHeight) {
+			return;
+		}
+	}
+}
+
+void CompactAVL::RemoveLast(uint32_t* path, int depth) {
+	uint32_t node = path[depth - 1];
+	uint32_t child = (nodes_[node].left_ != kNil) ?
+		nodes_[node].left_ : nodes_[node].right_;
+	if (depth == 1) {
+		root_ = child;
+	} else if (nodes_[path[depth - 2]].left_ == node) {
+		nodes_[path[depth - 2]].left_ = child;
+	} else {
+		nodes_[path[depth - 2]].right_ = child;
+	}
+	FreeNode(node);
+	size_--;
+	Retrace(path, depth - 1);
+}
+
+void CompactAVL::Insert(int key) {
+	uint32_t path[kMaxDepth];
+	int depth = 0;
+	uint32_t currentNode = root_;
+	while (currentNode != kNil) {
+		assert(depth < kMaxDepth);
+		path[depth++] = currentNode;
+		currentNode = (key < nodes_[currentNode].key_) ?
+			nodes_[currentNode].left_ : nodes_[currentNode].right_;
+	}
+	// NewNode may reallocate nodes_, so no references are held across it
+	uint32_t node = NewNode(key);
+	if (depth == 0) {
+		root_ = node;
+	} else if (key < nodes_[path[depth - 1]].key_) {
+		nodes_[path[depth - 1]].left_ = node;
+	} else {
+		nodes_[path[depth - 1]].right_ = node;
+	}
+	size_++;
+	Retrace(path, depth);
+}
+
+bool CompactAVL::Delete(int key) {
+	uint32_t path[kMaxDepth];
+	int depth = 0;
+	uint32_t currentNode = root_;
+	while (currentNode != kNil && nodes_[currentNode].key_ != key) {
+		assert(depth < kMaxDepth);
+		path[depth++] = currentNode;
+		currentNode = (key < nodes_[currentNode].key_) ?
+			nodes_[currentNode].left_ : nodes_[currentNode].right_;
+	}
+	if (currentNode == kNil) {
+		return false;
+	}
+	assert(depth < kMaxDepth);
+	path[depth++] = currentNode;
+	if (nodes_[currentNode].left_ != kNil && nodes_[currentNode].right_ != kNil) {
+		// move the in-order successor's key up and unlink the successor
+		uint32_t successor = nodes_[currentNode].right_;
+		while (successor != kNil) {
+			assert(depth < kMaxDepth);
+			path[depth++] = successor;
+			successor = nodes_[successor].left_;
+		}
+		nodes_[currentNode].key_ = nodes_[path[depth - 1]].key_;
+	}
+	RemoveLast(path, depth);
+	return true;
+}
+
+int CompactAVL::DeleteMin() {
+	uint32_t path[kMaxDepth];
+	int depth = 0;
+	uint32_t currentNode = root_;
+	while (currentNode != kNil) {
+		assert(depth < kMaxDepth);
+		path[depth++] = currentNode;
+		currentNode = nodes_[currentNode].left_;
+	}
+	assert(depth > 0);
+	int result = nodes_[path[depth - 1]].key_;
+	RemoveLast(path, depth);
+	return result;
+}
+
+bool CompactAVL::Find(int key) const {
+	uint32_t currentNode = root_;
+	while (currentNode != kNil) {
+		const CompactAVLNode& v = nodes_[currentNode];
+		if (v.key_ == key) {
+			return true;
+		}
+		currentNode = (key < v.key_) ? v.left_ : v.right_;
+	}
+	return false;
+}
+
+size_t CompactAVL::size() const {
+	return size_;
+}
+
+bool CompactAVL::empty() const {
+	return size_ == 0;
+}
+
+void CompactAVL::reserve(size_t n) {
+	nodes_.reserve(n + 1);
+}
+
+std::string CompactAVL::JSON() const {
+	nlohmann::json result;
+	// (node, parent) pairs, the compact layout keeps no parent links
+	std::queue< std::pair<uint32_t, uint32_t> > nodes;
+	if (root_ != kNil) {
+		result["root"] = nodes_[root_].key_;
+		nodes.push(std::make_pair(root_, kNil));
+		while (!nodes.empty()) {
+			auto v = nodes.front();
+			nodes.pop();
+			const CompactAVLNode& node = nodes_[v.first];
+			std::string key = std::to_string(node.key_);
+			if (node.left_ != kNil) {
+				result[key]["left"] = nodes_[node.left_].key_;
+				nodes.push(std::make_pair(node.left_, v.first));
+			}
+			if (node.right_ != kNil) {
+				result[key]["right"] = nodes_[node.right_].key_;
+				nodes.push(std::make_pair(node.right_, v.first));
+			}
+			if (v.second != kNil) {
+				result[key]["parent"] = nodes_[v.second].key_;
+			} else {
+				result[key]["root"] = true;
+			}
+		}
+	}
+	result["size"] = size_;
+	return result.dump(2) + "\n";
+}
@@ -0,0 +1,65 @@
+#ifndef COMPACTAVL_H
+#define COMPACTAVL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CompactAVL;
+
+// 16 byte node: four of them share a cache line. Children are 32-bit
+// indices into CompactAVL::nodes_, and there is no parent link, updates
+// keep the search path on a small fixed stack instead.
+class CompactAVLNode {
+ public:
+ 	CompactAVLNode(int key);
+
+ private:
+  int key_;
+  uint32_t left_;
+  uint32_t right_;
+  int8_t height_;
+
+  friend CompactAVL;
+}; // class CompactAVLNode
+
+class CompactAVL {
+ public:
+ 	CompactAVL();
+
+ 	void Insert(int key);
+ 	bool Delete(int key);
+ 	bool Find(int key) const;
+ 	std::string JSON() const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+ 	// preallocates room for n keys so bulk loads never reallocate nodes_
+ 	void reserve(size_t n);
+
+ private:
+	// index 0 is a sentinel standing in for nullptr, its height is -1
+	static const uint32_t kNil = 0;
+	// an AVL tree over 2^32 nodes is at most 46 levels deep
+	static const int kMaxDepth = 64;
+
+	uint32_t NewNode(int key);
+	void FreeNode(uint32_t node);
+	void FixHeight(uint32_t node);
+	int BalanceFactor(uint32_t node) const;
+	uint32_t RotateLeft(uint32_t node);
+	uint32_t RotateRight(uint32_t node);
+	uint32_t Rebalance(uint32_t node);
+	// fixes heights and rotates from path[depth - 1] back up to the root
+	void Retrace(uint32_t* path, int depth);
+	// unlinks path[depth - 1], which must have at most one child
+	void RemoveLast(uint32_t* path, int depth);
+
+	std::vector<CompactAVLNode> nodes_;
+	uint32_t root_;
+	// freed slots are chained through left_
+	uint32_t free_;
+ 	size_t size_;
+}; // class CompactAVL
+
+#endif // COMPACTAVL_H
@@ -0,0 +1,87 @@
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "AVL.h"
+#include "CompactAVL.h"
+#include "json.hpp"
+
+#define SAMPLE_SIZE 1000
+#define NUM_TESTS 2000
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+	// small range, so deletes hit and keys repeat
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE);
+	std::uniform_int_distribution<int> op(0, 3);
+
+	std::cout << "Running tests..." << std::flush;
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		CompactAVL T;
+		std::multiset<int> model;
+		for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+			int x = unif(rng);
+			switch (op(rng)) {
+			case 0: {
+				bool deleted = T.Delete(x);
+				assert(deleted == (model.count(x) != 0));
+				if (deleted) {
+					model.erase(model.find(x));
+				}
+				break;
+			}
+			case 1:
+				if (!model.empty()) {
+					assert(T.DeleteMin() == *model.begin());
+					model.erase(model.begin());
+				}
+				break;
+			default:
+				T.Insert(x);
+				model.insert(x);
+			}
+			assert(T.Find(x) == (model.count(x) != 0));
+			assert(T.size() == model.size());
+		}
+		while (!T.empty()) {
+			assert(T.DeleteMin() == *model.begin());
+			model.erase(model.begin());
+		}
+		assert(model.empty());
+		// both insert by the same rotations, so distinct keys give the
+		// same shape as AVL
+		if (sample % 10 == 0) {
+			AVL reference;
+			std::set<int> keys;
+			while (keys.size() < SAMPLE_SIZE) {
+				int x = unif(rng) * SAMPLE_SIZE + unif(rng);
+				if (keys.insert(x).second) {
+					T.Insert(x);
+					reference.Insert(x);
+				}
+			}
+			assert(nlohmann::json::parse(T.JSON()) == nlohmann::json::parse(reference.JSON()));
+		}
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+	// ascending keys are the worst case for the path stack, every insert
+	// retraces the whole right spine
+	CompactAVL sorted;
+	sorted.reserve(1 << 20);
+	for (int i = 0; i < (1 << 20); i++) {
+		sorted.Insert(i);
+	}
+	for (int i = 0; i < (1 << 20); i += 2) {
+		assert(sorted.Delete(i));
+	}
+	for (int i = 0; i < (1 << 20); i++) {
+		assert(sorted.Find(i) == (i % 2 == 1));
+	}
+	std::cout << "Tests complete.\n";
+}
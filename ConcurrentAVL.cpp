@@ -0,0 +1,385 @@
+#include "ConcurrentAVL.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <thread>
+
+#include "json.hpp"
+
+ConcurrentAVLNode::ConcurrentAVLNode(int key, ConcurrentAVLNode* parent) :
+	key_(key),
+	present_(true),
+	version_(0),
+	left_(nullptr),
+	right_(nullptr),
+	parent_(parent),
+	height_(0) {}
+
+ConcurrentAVL::ReaderGuard::ReaderGuard(const ConcurrentAVL& tree) {
+	// each thread keeps coming back to the slot it had last time, so the
+	// compare-exchange below almost never contends
+	static thread_local size_t hint = std::hash<std::thread::id>()(
+		std::this_thread::get_id()) % kReaderSlots;
+	uint64_t epoch = tree.epoch_.load();
+	for (size_t i = hint, tried = 1; ; i = (i + 1) % kReaderSlots, tried++) {
+		uint64_t idle = 0;
+		if (tree.readers_[i].epoch.compare_exchange_strong(idle, epoch)) {
+			hint = i;
+			slot_ = &tree.readers_[i];
+			return;
+		}
+		// more readers than slots: after a full lap let the holders run
+		// instead of spinning against them
+		if (tried % kReaderSlots == 0) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+ConcurrentAVL::ReaderGuard::~ReaderGuard() {
+	slot_->epoch.store(0, std::memory_order_release);
+}
+
+ConcurrentAVL::ConcurrentAVL() : holder_(0, nullptr), size_(0), epoch_(1) {
+	for (ReaderSlot& reader : readers_) {
+		reader.epoch.store(0);
+	}
+}
+
+bool ConcurrentAVL::Insert(int key) {
+	std::lock_guard<std::mutex> lock(writer_);
+	Node* parent = &holder_;
+	Node* currentNode = holder_.right_.load();
+	bool right = true;
+	while (currentNode != nullptr) {
+		if (currentNode->key_ == key) {
+			if (currentNode->present_.load()) {
+				return false;
+			}
+			// a routing node for key, bring it back to life
+			currentNode->present_.store(true);
+			size_++;
+			return true;
+		}
+		parent = currentNode;
+		right = (currentNode->key_ < key);
+		currentNode = Child(currentNode, right);
+	}
+	// fully built before it is published, growing a subtree is always safe
+	// for readers so the parent's version stays as it is
+	Node* node = pool_.Allocate(key, parent);
+	(right ? parent->right_ : parent->left_).store(node);
+	size_++;
+	Retrace(parent);
+	Reclaim();
+	return true;
+}
+
+bool ConcurrentAVL::Delete(int key) {
+	std::lock_guard<std::mutex> lock(writer_);
+	Node* node = Locate(key);
+	if (node == nullptr || !node->present_.load()) {
+		return false;
+	}
+	node->present_.store(false);
+	size_--;
+	if (node->left_.load() != nullptr && node->right_.load() != nullptr) {
+		// stays as a routing node until a child goes away
+		return true;
+	}
+	Node* parent = node->parent_;
+	Unlink(node);
+	Retrace(parent);
+	Reclaim();
+	return true;
+}
+
+bool ConcurrentAVL::Find(int key) const {
+	ReaderGuard guard(*this);
+	while (true) {
+		Outcome outcome = AttemptFind(key, &holder_, true, holder_.version_.load());
+		if (outcome != kRetry) {
+			return outcome == kFound;
+		}
+	}
+}
+
+std::string ConcurrentAVL::JSON() const {
+	std::lock_guard<std::mutex> lock(writer_);
+	nlohmann::json result;
+	std::queue<const Node*> nodes;
+	const Node* root = holder_.right_.load();
+	if (root != nullptr) {
+		result["root"] = root->key_;
+		nodes.push(root);
+		while (!nodes.empty()) {
+			const Node* v = nodes.front();
+			nodes.pop();
+			std::string key = std::to_string(v->key_);
+			const Node* left = v->left_.load();
+			const Node* right = v->right_.load();
+			if (left != nullptr) {
+				result[key]["left"] = left->key_;
+				nodes.push(left);
+			}
+			if (right != nullptr) {
+				result[key]["right"] = right->key_;
+				nodes.push(right);
+			}
+			if (v->parent_ != &holder_) {
+				result[key]["parent"] = v->parent_->key_;
+			} else {
+				result[key]["root"] = true;
+			}
+			if (!v->present_.load()) {
+				result[key]["routing"] = true;
+			}
+		}
+	}
+	result["size"] = size_.load();
+	return result.dump(2) + "\n";
+}
+
+size_t ConcurrentAVL::size() const {
+	return size_.load();
+}
+
+bool ConcurrentAVL::empty() const {
+	return size_.load() == 0;
+}
+
+int ConcurrentAVL::DeleteMin() {
+	std::lock_guard<std::mutex> lock(writer_);
+	if (size_.load() == 0) {
+		std::cerr << "DeleteMin called on an empty ConcurrentAVL" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	// in-order from the leftmost node to the first key that is present,
+	// only routing nodes can come before it
+	Node* node = holder_.right_.load();
+	while (node->left_.load() != nullptr) {
+		node = node->left_.load();
+	}
+	while (!node->present_.load()) {
+		if (node->right_.load() != nullptr) {
+			node = node->right_.load();
+			while (node->left_.load() != nullptr) {
+				node = node->left_.load();
+			}
+		} else {
+			Node* child = node;
+			node = node->parent_;
+			while (child == node->right_.load()) {
+				child = node;
+				node = node->parent_;
+			}
+		}
+	}
+	int result = node->key_;
+	node->present_.store(false);
+	size_--;
+	if (node->left_.load() == nullptr || node->right_.load() == nullptr) {
+		Node* parent = node->parent_;
+		Unlink(node);
+		Retrace(parent);
+		Reclaim();
+	}
+	return result;
+}
+
+ConcurrentAVL::Outcome ConcurrentAVL::AttemptFind(int key, const Node* node, bool right,
+		uint64_t nodeVersion) const {
+	// node was valid, holding key in its right or left subtree, as of
+	// nodeVersion; once its version moves on that may no longer hold
+	while (true) {
+		const Node* child = Child(node, right);
+		if (node->version_.load() != nodeVersion) {
+			return kRetry;
+		}
+		if (child == nullptr) {
+			return kNotFound;
+		}
+		if (child->key_ == key) {
+			return child->present_.load() ? kFound : kNotFound;
+		}
+		uint64_t childVersion = child->version_.load();
+		if (childVersion & kShrinking) {
+			WaitUntilNotShrinking(child);
+			continue;
+		}
+		if ((childVersion & kUnlinked) || child != Child(node, right)) {
+			continue;
+		}
+		if (node->version_.load() != nodeVersion) {
+			return kRetry;
+		}
+		// child is a valid hand-over point as of childVersion
+		Outcome outcome = AttemptFind(key, child, child->key_ < key, childVersion);
+		if (outcome != kRetry) {
+			return outcome;
+		}
+	}
+}
+
+void ConcurrentAVL::WaitUntilNotShrinking(const Node* node) {
+	while (node->version_.load() & kShrinking) {
+		std::this_thread::yield();
+	}
+}
+
+ConcurrentAVLNode* ConcurrentAVL::Child(const Node* node, bool right) {
+	return right ? node->right_.load() : node->left_.load();
+}
+
+ConcurrentAVLNode* ConcurrentAVL::Locate(int key) const {
+	Node* currentNode = holder_.right_.load();
+	while (currentNode != nullptr && currentNode->key_ != key) {
+		currentNode = Child(currentNode, currentNode->key_ < key);
+	}
+	return currentNode;
+}
+
+void ConcurrentAVL::Unlink(Node* node) {
+	// node has at most one child, which takes its place; readers still in
+	// node fail validation on kUnlinked and back up to the parent
+	Node* child = (node->left_.load() != nullptr) ? node->left_.load() : node->right_.load();
+	if (child != nullptr) {
+		child->parent_ = node->parent_;
+	}
+	ReplaceChild(node->parent_, node, child);
+	node->version_.store(kUnlinked);
+	Retire(node);
+}
+
+void ConcurrentAVL::Retire(Node* node) {
+	retired_.push_back(std::make_pair(node, epoch_.load()));
+}
+
+void ConcurrentAVL::Reclaim() {
+	if (retired_.size() < kReclaimBatch) {
+		return;
+	}
+	// readers that enter from now on cannot reach anything retired so far
+	uint64_t oldest = epoch_.fetch_add(1) + 1;
+	for (const ReaderSlot& reader : readers_) {
+		uint64_t epoch = reader.epoch.load();
+		if (epoch != 0) {
+			oldest = std::min(oldest, epoch);
+		}
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < retired_.size(); i++) {
+		if (retired_[i].second < oldest) {
+			pool_.Free(retired_[i].first);
+		} else {
+			retired_[kept++] = retired_[i];
+		}
+	}
+	retired_.resize(kept);
+}
+
+void ConcurrentAVL::Retrace(Node* node) {
+	while (node != &holder_) {
+		Node* left = node->left_.load();
+		Node* right = node->right_.load();
+		if (!node->present_.load() && (left == nullptr || right == nullptr)) {
+			// a routing node that lost a child is no longer needed
+			Node* parent = node->parent_;
+			Unlink(node);
+			node = parent;
+			continue;
+		}
+		int oldHeight = node->height_;
+		FixHeight(node);
+		Node* top = Rebalance(node);
+		if (top == node && node->height_ == oldHeight) {
+			return;
+		}
+		node = top->parent_;
+	}
+}
+
+int ConcurrentAVL::Height(const Node* node) {
+	return (node == nullptr) ? -1 : node->height_;
+}
+
+void ConcurrentAVL::FixHeight(Node* node) {
+	node->height_ = 1 + std::max(Height(node->left_.load()), Height(node->right_.load()));
+}
+
+ConcurrentAVLNode* ConcurrentAVL::Rebalance(Node* node) {
+	Node* left = node->left_.load();
+	Node* right = node->right_.load();
+	int balance = Height(right) - Height(left);
+	if (balance > 1) {
+		if (Height(right->right_.load()) < Height(right->left_.load())) {
+			RotateRight(right);
+		}
+		RotateLeft(node);
+		return node->parent_;
+	}
+	if (balance < -1) {
+		if (Height(left->left_.load()) < Height(left->right_.load())) {
+			RotateLeft(left);
+		}
+		RotateRight(node);
+		return node->parent_;
+	}
+	return node;
+}
+
+void ConcurrentAVL::RotateLeft(Node* node) {
+	// node moves down and loses its right part, pivot only gains keys
+	Node* pivot = node->right_.load();
+	Node* parent = node->parent_;
+	Node* middle = pivot->left_.load();
+	BeginShrink(node);
+	node->right_.store(middle);
+	if (middle != nullptr) {
+		middle->parent_ = node;
+	}
+	pivot->left_.store(node);
+	node->parent_ = pivot;
+	pivot->parent_ = parent;
+	ReplaceChild(parent, node, pivot);
+	EndShrink(node);
+	FixHeight(node);
+	FixHeight(pivot);
+}
+
+void ConcurrentAVL::RotateRight(Node* node) {
+	Node* pivot = node->left_.load();
+	Node* parent = node->parent_;
+	Node* middle = pivot->right_.load();
+	BeginShrink(node);
+	node->left_.store(middle);
+	if (middle != nullptr) {
+		middle->parent_ = node;
+	}
+	pivot->right_.store(node);
+	node->parent_ = pivot;
+	pivot->parent_ = parent;
+	ReplaceChild(parent, node, pivot);
+	EndShrink(node);
+	FixHeight(node);
+	FixHeight(pivot);
+}
+
+void ConcurrentAVL::ReplaceChild(Node* parent, Node* oldChild, Node* newChild) {
+	if (parent->left_.load() == oldChild) {
+		parent->left_.store(newChild);
+	} else {
+		parent->right_.store(newChild);
+	}
+}
+
+void ConcurrentAVL::BeginShrink(Node* node) {
+	node->version_.store(node->version_.load() | kShrinking);
+}
+
+void ConcurrentAVL::EndShrink(Node* node) {
+	node->version_.store((node->version_.load() + kVersionStep) & ~kShrinking);
+}
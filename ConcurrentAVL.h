@@ -0,0 +1,122 @@
+#ifndef CONCURRENTAVL_H
+#define CONCURRENTAVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NodePool.h"
+
+class ConcurrentAVL;
+
+// Keys never change once a node is linked. A node whose key was deleted
+// while it still had two children stays in the tree as a routing node with
+// present_ cleared, so readers never see a key move between nodes.
+class ConcurrentAVLNode {
+ public:
+ 	ConcurrentAVLNode(int key, ConcurrentAVLNode* parent);
+
+ private:
+  const int key_;
+  std::atomic<bool> present_;
+  // kShrinking and kUnlinked flags plus a change count, see ConcurrentAVL
+  std::atomic<uint64_t> version_;
+  std::atomic<ConcurrentAVLNode*> left_;
+  std::atomic<ConcurrentAVLNode*> right_;
+  // only ever touched by the writer
+  ConcurrentAVLNode* parent_;
+  int height_;
+
+  friend ConcurrentAVL;
+}; // class ConcurrentAVLNode
+
+// AVL set of ints for one writer and any number of readers. Insert, Delete
+// and DeleteMin serialize on a mutex; Find takes no lock. Readers descend
+// hand over hand with optimistic validation (Bronson et al., "A Practical
+// Concurrent Binary Search Tree"): before leaving a node they check its
+// version is unchanged, and a rotation marks the node it moves down as
+// shrinking while it relinks, so a reader either sees a consistent path or
+// retries from the deepest node that is still valid. Unlinked nodes are
+// retired and only reused once every reader that might hold them has left
+// (epoch-based reclamation).
+class ConcurrentAVL {
+ public:
+ 	ConcurrentAVL();
+ 	ConcurrentAVL(const ConcurrentAVL&) = delete;
+ 	ConcurrentAVL& operator=(const ConcurrentAVL&) = delete;
+
+ 	// a set, so Insert returns false if key is already present
+ 	bool Insert(int key);
+ 	bool Delete(int key);
+ 	// lock-free, safe to call from any thread at any time
+ 	bool Find(int key) const;
+ 	std::string JSON() const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+
+ private:
+	typedef ConcurrentAVLNode Node;
+
+	static const uint64_t kUnlinked = 1;
+	static const uint64_t kShrinking = 2;
+	// the change count lives above the flag bits
+	static const uint64_t kVersionStep = 4;
+	// Find's outcome, kRetry sends the search back one level
+	enum Outcome { kNotFound, kFound, kRetry };
+
+	// per-thread announcement of the epoch a reader entered in, 0 if idle;
+	// one line each so readers do not contend. Readers beyond kReaderSlots
+	// wait for a slot, yielding after every lap over them.
+	struct alignas(64) ReaderSlot {
+		std::atomic<uint64_t> epoch;
+	};
+	static const size_t kReaderSlots = 64;
+	// retired nodes are reclaimed in batches of this many
+	static const size_t kReclaimBatch = 64;
+
+	class ReaderGuard {
+	 public:
+		explicit ReaderGuard(const ConcurrentAVL& tree);
+		~ReaderGuard();
+
+	 private:
+		ReaderSlot* slot_;
+	};
+
+	Outcome AttemptFind(int key, const Node* node, bool right, uint64_t nodeVersion) const;
+	static void WaitUntilNotShrinking(const Node* node);
+	static Node* Child(const Node* node, bool right);
+
+	// writer side, called with writer_ held
+	Node* Locate(int key) const;
+	void Unlink(Node* node);
+	void Retire(Node* node);
+	void Reclaim();
+	void Retrace(Node* node);
+	static int Height(const Node* node);
+	static void FixHeight(Node* node);
+	Node* Rebalance(Node* node);
+	void RotateLeft(Node* node);
+	void RotateRight(Node* node);
+	void ReplaceChild(Node* parent, Node* oldChild, Node* newChild);
+	static void BeginShrink(Node* node);
+	static void EndShrink(Node* node);
+
+	// sentinel above the root, the root is its right child; its version
+	// never changes, so every search can fall back to it
+	Node holder_;
+	std::atomic<size_t> size_;
+	mutable std::mutex writer_;
+	NodePool<Node> pool_;
+	// retired nodes with the epoch they were retired in
+	std::vector< std::pair<Node*, uint64_t> > retired_;
+	mutable std::atomic<uint64_t> epoch_;
+	mutable ReaderSlot readers_[kReaderSlots];
+}; // class ConcurrentAVL
+
+#endif // CONCURRENTAVL_H
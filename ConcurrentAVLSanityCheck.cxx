@@ -0,0 +1,97 @@
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentAVL.h"
+
+// also built with -fsanitize=thread by make tsan
+#define SAMPLE_SIZE 3000
+#define NUM_TESTS 20
+#define NUM_READERS 4
+// more than ConcurrentAVL's reader slots, so some have to wait for one
+#define MANY_READERS 80
+
+// keys that are multiples of 3 in [0, 3 * SAMPLE_SIZE) are inserted before
+// the readers start and never deleted; the writer churns the others, and
+// negative keys for DeleteMin, which never reaches the stable ones
+void Reader(const ConcurrentAVL& T, const std::atomic<bool>& done, unsigned seed, size_t rounds) {
+	std::mt19937_64 rng(seed);
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE - 1);
+	for (size_t round = 0; round < rounds || (rounds == 0 && !done.load()); round++) {
+		int x = unif(rng);
+		assert(T.Find(3 * x));
+		// never inserted by anyone
+		assert(!T.Find(3 * SAMPLE_SIZE + 3 * x));
+		// churned, either answer is fine, it only has to return
+		T.Find(3 * x + 1);
+	}
+}
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE - 1);
+	std::uniform_int_distribution<int> op(0, 4);
+
+	std::cout << "Running tests..." << std::flush;
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		ConcurrentAVL T;
+		std::set<int> model;
+		for (int x = 0; x < SAMPLE_SIZE; x++) {
+			assert(T.Insert(3 * x));
+			model.insert(3 * x);
+		}
+		std::atomic<bool> done(false);
+		std::vector<std::thread> readers;
+		size_t count = (sample % 5 == 0) ? MANY_READERS : NUM_READERS;
+		for (size_t i = 0; i < count; i++) {
+			// the crowd makes a fixed number of lookups, the few run until
+			// the writer is done
+			readers.emplace_back(Reader, std::cref(T), std::cref(done), rng(),
+				(count == MANY_READERS) ? 200 : 0);
+		}
+		for (size_t i = 0; i < 10 * SAMPLE_SIZE; i++) {
+			int x = 3 * unif(rng) + 1 + (i % 2);
+			switch (op(rng)) {
+			case 0: {
+				bool deleted = T.Delete(x);
+				assert(deleted == (model.erase(x) != 0));
+				break;
+			}
+			case 1:
+				if (*model.begin() < 0) {
+					assert(T.DeleteMin() == *model.begin());
+					model.erase(model.begin());
+				}
+				break;
+			case 2:
+				x = -x;
+				// fall through
+			default:
+				assert(T.Insert(x) == model.insert(x).second);
+			}
+			assert(T.size() == model.size());
+		}
+		done.store(true);
+		for (std::thread& reader : readers) {
+			reader.join();
+		}
+		for (int x = -3 * SAMPLE_SIZE; x < 6 * SAMPLE_SIZE; x++) {
+			assert(T.Find(x) == (model.count(x) != 0));
+		}
+		while (!T.empty()) {
+			assert(T.DeleteMin() == *model.begin());
+			model.erase(model.begin());
+		}
+		assert(model.empty());
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+	std::cout << "Tests complete.\n";
+}
@@ -0,0 +1,80 @@
+#include "ForkJoinPool.h"
+
+#include <algorithm>
+
+ForkJoinPool::ForkJoinPool(unsigned threads) : stopping_(false) {
+	for (unsigned i = 1; i < threads; i++) {
+		workers_.push_back(std::thread(&ForkJoinPool::WorkerLoop, this));
+	}
+}
+
+ForkJoinPool::~ForkJoinPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+unsigned ForkJoinPool::size() const {
+	return workers_.size() + 1;
+}
+
+ForkJoinPool& ForkJoinPool::Default() {
+	static ForkJoinPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+void ForkJoinPool::Push(Task* task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		tasks_.push_back(task);
+	}
+	wake_.notify_one();
+}
+
+bool ForkJoinPool::RunOne() {
+	Task* task;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (tasks_.empty()) {
+			return false;
+		}
+		task = tasks_.back();
+		tasks_.pop_back();
+	}
+	task->run();
+	task->done.store(true, std::memory_order_release);
+	return true;
+}
+
+void ForkJoinPool::WaitFor(Task* task) {
+	while (!task->done.load(std::memory_order_acquire)) {
+		// the task is either still queued (likely on top, we pushed it last)
+		// or running elsewhere, in which case help with whatever else is queued
+		if (!RunOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ForkJoinPool::WorkerLoop() {
+	while (true) {
+		Task* task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+			if (stopping_ && tasks_.empty()) {
+				return;
+			}
+			// idle workers steal the oldest, i.e. biggest, task
+			task = tasks_.front();
+			tasks_.pop_front();
+		}
+		task->run();
+		task->done.store(true, std::memory_order_release);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef FORKJOINPOOL_H
+#define FORKJOINPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal fork-join pool for divide-and-conquer tree algorithms. Invoke
+// publishes the second half as a task, runs the first half on the calling
+// thread and then helps run queued tasks until the second half is done, so
+// nested Invoke calls never block a worker and cannot deadlock. Tasks must
+// not throw.
+class ForkJoinPool {
+ public:
+	// threads counts the calling thread, so threads - 1 workers are started
+	explicit ForkJoinPool(unsigned threads);
+	~ForkJoinPool();
+	ForkJoinPool(const ForkJoinPool&) = delete;
+	ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+	template <class Left, class Right>
+	void Invoke(Left&& left, Right&& right);
+	unsigned size() const;
+
+	// shared pool sized to std::thread::hardware_concurrency()
+	static ForkJoinPool& Default();
+
+ private:
+	struct Task {
+		std::function<void()> run;
+		std::atomic<bool> done;
+	};
+
+	void Push(Task* task);
+	// runs one queued task, newest first, returns false if none was queued
+	bool RunOne();
+	void WaitFor(Task* task);
+	void WorkerLoop();
+
+	std::vector<std::thread> workers_;
+	std::deque<Task*> tasks_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool stopping_;
+}; // class ForkJoinPool
+
+template <class Left, class Right>
+void ForkJoinPool::Invoke(Left&& left, Right&& right) {
+	if (workers_.empty()) {
+		left();
+		right();
+		return;
+	}
+	Task task;
+	task.run = std::ref(right);
+	task.done = false;
+	Push(&task);
+	left();
+	WaitFor(&task);
+}
+
+#endif // FORKJOINPOOL_H
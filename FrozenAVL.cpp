@@ -0,0 +1,135 @@
+#include "FrozenAVL.h"
+
+#include <cstdint>
+#include <utility>
+
+FrozenAVL::FrozenAVL() : offset_(0), size_(0) {}
+
+FrozenAVL::FrozenAVL(const int* first, const int* last) {
+	Allocate(last - first);
+	for (size_t k = First(); k != 0; k = Next(k)) {
+		*Slot(k) = *first++;
+	}
+}
+
+FrozenAVL::FrozenAVL(FrozenAVL&& other) :
+	storage_(std::move(other.storage_)),
+	offset_(other.offset_),
+	size_(other.size_) {
+	other.storage_.clear();
+	other.size_ = 0;
+}
+
+FrozenAVL& FrozenAVL::operator=(FrozenAVL&& other) {
+	if (this != &other) {
+		storage_ = std::move(other.storage_);
+		offset_ = other.offset_;
+		size_ = other.size_;
+		other.storage_.clear();
+		other.size_ = 0;
+	}
+	return *this;
+}
+
+void FrozenAVL::Allocate(size_t n) {
+	size_ = n;
+	storage_.assign(n + 1 + kLineKeys, 0);
+	uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+	uintptr_t line = kLineKeys * sizeof(int);
+	offset_ = ((line - address % line) % line) / sizeof(int);
+}
+
+int* FrozenAVL::Slot(size_t k) const {
+	return const_cast<int*>(storage_.data()) + offset_ + k;
+}
+
+bool FrozenAVL::Find(int key) const {
+	size_t k = Search(key);
+	return k != 0 && *Slot(k) == key;
+}
+
+bool FrozenAVL::LowerBound(int key, int* result) const {
+	size_t k = Search(key);
+	if (k == 0) {
+		return false;
+	}
+	*result = *Slot(k);
+	return true;
+}
+
+bool FrozenAVL::UpperBound(int key, int* result) const {
+	size_t k = SearchUpper(key);
+	if (k == 0) {
+		return false;
+	}
+	*result = *Slot(k);
+	return true;
+}
+
+size_t FrozenAVL::size() const {
+	return size_;
+}
+
+bool FrozenAVL::empty() const {
+	return size_ == 0;
+}
+
+std::vector<int> FrozenAVL::Keys() const {
+	std::vector<int> keys;
+	keys.reserve(size_);
+	for (size_t k = First(); k != 0; k = Next(k)) {
+		keys.push_back(*Slot(k));
+	}
+	return keys;
+}
+
+size_t FrozenAVL::Search(int key) const {
+	const int* keys = Slot(0);
+	size_t k = 1;
+	while (k <= size_) {
+		// only a hint, the address may lie past the end of the array
+		__builtin_prefetch(reinterpret_cast<const char*>(keys) +
+			kLineKeys * k * sizeof(int));
+		k = 2 * k + (keys[k] < key);
+	}
+	// every step right appended a 1 bit; the answer is the node where we
+	// last went left, found by dropping the trailing 1s and that 0
+	return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+}
+
+size_t FrozenAVL::SearchUpper(int key) const {
+	const int* keys = Slot(0);
+	size_t k = 1;
+	while (k <= size_) {
+		__builtin_prefetch(reinterpret_cast<const char*>(keys) +
+			kLineKeys * k * sizeof(int));
+		k = 2 * k + (keys[k] <= key);
+	}
+	return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+}
+
+size_t FrozenAVL::First() const {
+	if (size_ == 0) {
+		return 0;
+	}
+	size_t k = 1;
+	while (2 * k <= size_) {
+		k = 2 * k;
+	}
+	return k;
+}
+
+size_t FrozenAVL::Next(size_t k) const {
+	if (2 * k + 1 <= size_) {
+		k = 2 * k + 1;
+		while (2 * k <= size_) {
+			k = 2 * k;
+		}
+		return k;
+	}
+	// climb out of right children, then once more out of the left child
+	while (k & 1) {
+		k >>= 1;
+	}
+	return k >> 1;
+}
@@ -0,0 +1,66 @@
+#ifndef FROZENAVL_H
+#define FROZENAVL_H
+
+#include <cstddef>
+#include <vector>
+
+// Immutable sorted set of int keys laid out in Eytzinger (BFS) order: the
+// implicit tree has its root at index 1 and the children of k at 2k and
+// 2k + 1, all in one contiguous array with no pointers, so the only memory
+// per key is the key itself. Searches descend without data-dependent
+// branches and prefetch the cache line holding the node four levels down,
+// which keeps several misses in flight for a single lookup. Built in O(n)
+// from the sorted keys, see AVL::Freeze().
+class FrozenAVL {
+ public:
+ 	FrozenAVL();
+ 	// sorted keys, duplicates allowed
+ 	FrozenAVL(const int* first, const int* last);
+ 	// n keys read in order from first, e.g. AVL::begin()
+ 	template <class Iterator>
+ 	FrozenAVL(Iterator first, size_t n);
+ 	// a copy would land at a different cache line offset, so move only
+ 	FrozenAVL(const FrozenAVL&) = delete;
+ 	FrozenAVL& operator=(const FrozenAVL&) = delete;
+ 	FrozenAVL(FrozenAVL&& other);
+ 	FrozenAVL& operator=(FrozenAVL&& other);
+
+ 	bool Find(int key) const;
+ 	// sets *result to the first key >= key (> key), false if there is none
+ 	bool LowerBound(int key, int* result) const;
+ 	bool UpperBound(int key, int* result) const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	// the keys back in sorted order
+ 	std::vector<int> Keys() const;
+
+ private:
+	// ints per cache line, index 0 of the array starts a line so the 16
+	// descendants of k four levels down, 16k..16k + 15, share one line
+	static const size_t kLineKeys = 16;
+
+	void Allocate(size_t n);
+	int* Slot(size_t k) const;
+	// Eytzinger index of the first key >= key, or 0 if there is none
+	size_t Search(int key) const;
+	size_t SearchUpper(int key) const;
+	// index of the first node visited by an in-order walk of the implicit
+	// tree, and the one visited after k (0 past the end)
+	size_t First() const;
+	size_t Next(size_t k) const;
+
+	// backing store over-allocated by a line to align index 0
+	std::vector<int> storage_;
+	size_t offset_;
+	size_t size_;
+}; // class FrozenAVL
+
+template <class Iterator>
+FrozenAVL::FrozenAVL(Iterator first, size_t n) {
+	Allocate(n);
+	for (size_t k = First(); k != 0; k = Next(k), ++first) {
+		*Slot(k) = *first;
+	}
+}
+
+#endif // FROZENAVL_H
@@ -0,0 +1,217 @@
+#include "JSONReader.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+JSONReader::JSONReader(std::istream& in) :
+	buffer_(new char[kBufferSize]),
+	begin_(buffer_.get()),
+	next_(buffer_.get()),
+	end_(buffer_.get()),
+	stream_(&in),
+	offset_(0),
+	hasRoot_(false),
+	root_(0),
+	hasSize_(false),
+	size_(0) {}
+
+// the whole document is already in memory, so it is read in place
+JSONReader::JSONReader(const std::string& document) :
+	begin_(document.data()),
+	next_(document.data()),
+	end_(document.data() + document.size()),
+	stream_(nullptr),
+	offset_(0),
+	hasRoot_(false),
+	root_(0),
+	hasSize_(false),
+	size_(0) {}
+
+void JSONReader::ReadDocument() {
+	Expect('{');
+	if (Peek() == '}') {
+		Take();
+	} else {
+		while (true) {
+			char name[16];
+			ReadName(name, sizeof(name));
+			Expect(':');
+			if (std::strcmp(name, "root") == 0) {
+				root_ = ReadKey();
+				hasRoot_ = true;
+			} else if (std::strcmp(name, "size") == 0) {
+				if (Peek() == '-') {
+					SyntaxError("\"size\" is negative");
+				}
+				size_ = static_cast<unsigned long long>(ReadInteger());
+				hasSize_ = true;
+			} else {
+				ReadEntry(NameToKey(name));
+			}
+			Peek();
+			char c = Take();
+			if (c == '}') {
+				break;
+			}
+			if (c != ',') {
+				SyntaxError("expected ',' or '}'");
+			}
+		}
+	}
+	if (Peek() != EOF) {
+		SyntaxError("unexpected text after the document");
+	}
+}
+
+void JSONReader::ReadEntry(int key) {
+	Entry entry = {key, 0, 0, 0, 0};
+	Expect('{');
+	if (Peek() == '}') {
+		Take();
+	} else {
+		while (true) {
+			char name[8];
+			ReadName(name, sizeof(name));
+			Expect(':');
+			if (std::strcmp(name, "left") == 0) {
+				entry.left = ReadKey();
+				entry.fields |= kLeft;
+			} else if (std::strcmp(name, "right") == 0) {
+				entry.right = ReadKey();
+				entry.fields |= kRight;
+			} else if (std::strcmp(name, "parent") == 0) {
+				entry.parent = ReadKey();
+				entry.fields |= kParent;
+			} else if (std::strcmp(name, "root") == 0) {
+				Peek();
+				const char* literal = "true";
+				for (const char* c = literal; *c != '\0'; c++) {
+					if (Take() != *c) {
+						SyntaxError("expected true");
+					}
+				}
+				entry.fields |= kRoot;
+			} else {
+				SyntaxError("unknown member \"" + std::string(name) + "\" in a node");
+			}
+			Peek();
+			char c = Take();
+			if (c == '}') {
+				break;
+			}
+			if (c != ',') {
+				SyntaxError("expected ',' or '}'");
+			}
+		}
+	}
+	entries_.push_back(entry);
+}
+
+int JSONReader::Peek() {
+	while (true) {
+		if (next_ == end_ && !Fill()) {
+			return EOF;
+		}
+		char c = *next_;
+		if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+			return static_cast<unsigned char>(c);
+		}
+		next_++;
+	}
+}
+
+char JSONReader::Take() {
+	if (next_ == end_ && !Fill()) {
+		SyntaxError("unexpected end of input");
+	}
+	return *next_++;
+}
+
+void JSONReader::Expect(char c) {
+	Peek();
+	if (Take() != c) {
+		SyntaxError(std::string("expected '") + c + "'");
+	}
+}
+
+void JSONReader::ReadName(char* name, size_t capacity) {
+	Expect('"');
+	size_t length = 0;
+	for (char c = Take(); c != '"'; c = Take()) {
+		// no name in the schema needs escapes or is this long
+		if (c == '\\' || length + 1 == capacity) {
+			SyntaxError("unexpected member name");
+		}
+		name[length++] = c;
+	}
+	name[length] = '\0';
+}
+
+long long JSONReader::ReadInteger() {
+	bool negative = false;
+	if (Peek() == '-') {
+		Take();
+		negative = true;
+	}
+	if (next_ == end_ && !Fill()) {
+		SyntaxError("unexpected end of input");
+	}
+	if (*next_ < '0' || *next_ > '9') {
+		SyntaxError("expected an integer");
+	}
+	long long value = 0;
+	int digits = 0;
+	while ((next_ != end_ || Fill()) && *next_ >= '0' && *next_ <= '9') {
+		// more than fit in an int is an error anyway, this just keeps the
+		// arithmetic from overflowing before the caller sees it
+		if (++digits > 18) {
+			SyntaxError("integer out of range");
+		}
+		value = value * 10 + (*next_++ - '0');
+	}
+	return negative ? -value : value;
+}
+
+int JSONReader::ReadKey() {
+	long long value = ReadInteger();
+	if (value < INT_MIN || value > INT_MAX) {
+		SyntaxError("key out of range");
+	}
+	return static_cast<int>(value);
+}
+
+int JSONReader::NameToKey(const char* name) const {
+	char* end = nullptr;
+	long long value = std::strtoll(name, &end, 10);
+	if (*name == '\0' || *end != '\0' || value < INT_MIN || value > INT_MAX) {
+		SyntaxError("member \"" + std::string(name) + "\" is not a key");
+	}
+	return static_cast<int>(value);
+}
+
+bool JSONReader::Fill() {
+	if (stream_ == nullptr) {
+		return false;
+	}
+	offset_ += end_ - begin_;
+	stream_->read(buffer_.get(), kBufferSize);
+	begin_ = next_ = buffer_.get();
+	end_ = begin_ + stream_->gcount();
+	return next_ != end_;
+}
+
+size_t JSONReader::Position() const {
+	return offset_ + (next_ - begin_);
+}
+
+void JSONReader::SyntaxError(const std::string& reason) const {
+	Fail(reason + " at byte " + std::to_string(Position()));
+}
+
+void JSONReader::Fail(const std::string& reason) {
+	std::cerr << "JSONReader Error: " << reason << "\n";
+	exit(EXIT_FAILURE);
+}
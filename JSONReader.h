@@ -0,0 +1,228 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reads back the JSON() schema of a BST or AVL tree: one "key": {"left",
+// "parent", "right", "root"} object per node, in any order and with any
+// whitespace, plus "root" and "size". The counterpart of JSONWriter: it
+// streams through one fixed 64 KiB buffer and keeps only a few ints per
+// node instead of a document, then links the nodes straight from their
+// left and right members through a key -> node table, so the shape comes
+// back exactly in O(n) without a single comparison or rotation.
+//
+// Anything that is not a binary search tree over distinct keys in this
+// schema is reported with its byte offset and exits; trees with duplicate
+// keys cannot be read back, JSON() gives each copy a member of the same
+// name.
+class JSONReader {
+ public:
+	explicit JSONReader(std::istream& in);
+	explicit JSONReader(const std::string& document);
+	JSONReader(const JSONReader&) = delete;
+	JSONReader& operator=(const JSONReader&) = delete;
+
+	// reads the whole document and builds its nodes from pool, returns the
+	// root and sets *size; fields other than key_ and the links are left
+	// to the caller. Call it once.
+	template <class Node, class Pool>
+	Node* ReadTree(Pool& pool, size_t* size);
+
+ private:
+	static const size_t kBufferSize = 1 << 16;
+	// which members an entry had
+	enum Field { kLeft = 1, kRight = 2, kParent = 4, kRoot = 8 };
+
+	// key -> node by open addressing over a power-of-two table at most
+	// half full; the key is read from the node, so a slot is one pointer
+	template <class Node>
+	class KeyTable {
+	 public:
+		explicit KeyTable(size_t count);
+		// false if a node with the same key is already there
+		bool Insert(Node* node);
+		Node* Find(int key) const;
+
+	 private:
+		size_t Slot(int key) const;
+
+		std::vector<Node*> slots_;
+		size_t mask_;
+	};
+
+	struct Entry {
+		int key;
+		int left;
+		int right;
+		int parent;
+		unsigned fields;
+	};
+
+	void ReadDocument();
+	void ReadEntry(int key);
+	// next character after any whitespace without consuming it, EOF at
+	// the end of the input
+	int Peek();
+	// next character, whitespace included
+	char Take();
+	void Expect(char c);
+	// a member name into name, which holds capacity bytes
+	void ReadName(char* name, size_t capacity);
+	long long ReadInteger();
+	// an int value, and an int spelled out as a member name
+	int ReadKey();
+	int NameToKey(const char* name) const;
+	bool Fill();
+	size_t Position() const;
+	// a syntax error, reported with where in the input it was found
+	void SyntaxError(const std::string& reason) const;
+	static void Fail(const std::string& reason);
+
+	std::unique_ptr<char[]> buffer_;
+	const char* begin_;
+	const char* next_;
+	const char* end_;
+	std::istream* stream_;
+	// bytes of input before begin_
+	size_t offset_;
+
+	std::vector<Entry> entries_;
+	bool hasRoot_;
+	int root_;
+	bool hasSize_;
+	unsigned long long size_;
+}; // class JSONReader
+
+template <class Node, class Pool>
+Node* JSONReader::ReadTree(Pool& pool, size_t* size) {
+	ReadDocument();
+	std::vector<Node*> nodes(entries_.size());
+	pool.Reserve(entries_.size());
+	KeyTable<Node> keys(entries_.size());
+	for (size_t i = 0; i < entries_.size(); i++) {
+		nodes[i] = pool.Allocate(entries_[i].key);
+		if (!keys.Insert(nodes[i])) {
+			Fail("key " + std::to_string(entries_[i].key) + " appears twice");
+		}
+	}
+	if (!hasSize_ || size_ != entries_.size()) {
+		Fail("\"size\" does not match the number of nodes");
+	}
+	for (size_t i = 0; i < entries_.size(); i++) {
+		const Entry& entry = entries_[i];
+		for (int side = 0; side < 2; side++) {
+			if (!(entry.fields & (side == 0 ? kLeft : kRight))) {
+				continue;
+			}
+			Node* child = keys.Find(side == 0 ? entry.left : entry.right);
+			if (child == nullptr) {
+				Fail("node " + std::to_string(entry.key) + " has a child that is not in the document");
+			}
+			// each node gets at most one parent, so the links form a tree
+			// exactly when they reach every node from the root below
+			if (child->parent_ != nullptr || child == nodes[i]) {
+				Fail("node " + std::to_string(child->key_) + " has two parents");
+			}
+			child->parent_ = nodes[i];
+			(side == 0 ? nodes[i]->left_ : nodes[i]->right_) = child;
+		}
+	}
+	Node* root = nullptr;
+	if (hasRoot_) {
+		root = keys.Find(root_);
+		if (root == nullptr || root->parent_ != nullptr) {
+			Fail("\"root\" does not name the top of the tree");
+		}
+	}
+	// the parent members only repeat what the child links say, but a
+	// document where they disagree did not come from JSON()
+	for (size_t i = 0; i < entries_.size(); i++) {
+		const Entry& entry = entries_[i];
+		bool matches = (entry.fields & kParent) ?
+			nodes[i]->parent_ != nullptr && nodes[i]->parent_->key_ == entry.parent :
+			nodes[i] == root && (entry.fields & kRoot);
+		if (!matches) {
+			Fail("node " + std::to_string(entry.key) + " disagrees with its parent");
+		}
+	}
+	// in order through the parent links: the keys must come out ascending,
+	// and all of them, or some were not connected to the root
+	size_t count = 0;
+	const Node* node = root;
+	while (node != nullptr && node->left_ != nullptr) {
+		node = node->left_;
+	}
+	const Node* previous = nullptr;
+	while (node != nullptr) {
+		if (previous != nullptr && previous->key_ >= node->key_) {
+			Fail("keys are not in search tree order");
+		}
+		previous = node;
+		count++;
+		if (node->right_ != nullptr) {
+			node = node->right_;
+			while (node->left_ != nullptr) {
+				node = node->left_;
+			}
+		} else {
+			const Node* child = node;
+			node = node->parent_;
+			while (node != nullptr && child == node->right_) {
+				child = node;
+				node = node->parent_;
+			}
+		}
+	}
+	if (count != entries_.size()) {
+		Fail("some nodes are not reachable from \"root\"");
+	}
+	std::vector<Entry>().swap(entries_);
+	*size = count;
+	return root;
+}
+
+template <class Node>
+JSONReader::KeyTable<Node>::KeyTable(size_t count) {
+	size_t capacity = 16;
+	while (capacity < 2 * count) {
+		capacity *= 2;
+	}
+	slots_.assign(capacity, nullptr);
+	mask_ = capacity - 1;
+}
+
+template <class Node>
+bool JSONReader::KeyTable<Node>::Insert(Node* node) {
+	for (size_t i = Slot(node->key_); ; i = (i + 1) & mask_) {
+		if (slots_[i] == nullptr) {
+			slots_[i] = node;
+			return true;
+		}
+		if (slots_[i]->key_ == node->key_) {
+			return false;
+		}
+	}
+}
+
+template <class Node>
+Node* JSONReader::KeyTable<Node>::Find(int key) const {
+	for (size_t i = Slot(key); slots_[i] != nullptr; i = (i + 1) & mask_) {
+		if (slots_[i]->key_ == key) {
+			return slots_[i];
+		}
+	}
+	return nullptr;
+}
+
+template <class Node>
+size_t JSONReader::KeyTable<Node>::Slot(int key) const {
+	// Fibonacci hashing, the high half of the product is the well mixed part
+	return (static_cast<uint64_t>(static_cast<uint32_t>(key)) * 0x9e3779b97f4a7c15ull >> 32) & mask_;
+}
+
+#endif // JSONREADER_H
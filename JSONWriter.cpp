@@ -0,0 +1,236 @@
+#include "JSONWriter.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+
+// "00" "01" ... "99", two digits per division
+const char kDigitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+} // namespace
+
+JSONWriter::JSONWriter(std::ostream& out, bool compact) :
+	buffer_(new char[kBufferSize]),
+	used_(0),
+	stream_(&out),
+	string_(nullptr),
+	fd_(-1),
+	compact_(compact) {}
+
+JSONWriter::JSONWriter(int fd, bool compact) :
+	buffer_(new char[kBufferSize]),
+	used_(0),
+	stream_(nullptr),
+	string_(nullptr),
+	fd_(fd),
+	compact_(compact) {}
+
+JSONWriter::JSONWriter(std::string* out, bool compact) :
+	buffer_(new char[kBufferSize]),
+	used_(0),
+	stream_(nullptr),
+	string_(out),
+	fd_(-1),
+	compact_(compact) {}
+
+JSONWriter::~JSONWriter() {
+	Flush();
+}
+
+void JSONWriter::Flush() {
+	Output(buffer_.get(), used_);
+	used_ = 0;
+}
+
+void JSONWriter::Output(const char* data, size_t length) {
+	if (stream_ != nullptr) {
+		stream_->write(data, length);
+	} else if (string_ != nullptr) {
+		string_->append(data, length);
+	} else {
+		size_t written = 0;
+		while (written < length) {
+			ssize_t result = ::write(fd_, data + written, length - written);
+			if (result < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				std::cerr << "JSONWriter: write failed: " << std::strerror(errno) << std::endl;
+				exit(EXIT_FAILURE);
+			}
+			written += result;
+		}
+	}
+}
+
+void JSONWriter::Begin() {
+	Append("{", 1);
+	if (!compact_) {
+		Append("\n", 1);
+	}
+}
+
+void JSONWriter::Entry(int depth, int key, const int* left, const int* parent, const int* right, bool root) {
+	Indent(depth);
+	Append("\"", 1);
+	AppendInt(key);
+	Append(compact_ ? "\":{" : "\": {", compact_ ? 3 : 4);
+	// the fields in nlohmann's (alphabetical) order, every key has a
+	// parent or is the root, so there is always at least one
+	bool first = true;
+	if (left != nullptr) {
+		Field(depth + 1, "left", 4, *left, first);
+		first = false;
+	}
+	if (parent != nullptr) {
+		Field(depth + 1, "parent", 6, *parent, first);
+		first = false;
+	}
+	if (right != nullptr) {
+		Field(depth + 1, "right", 5, *right, first);
+		first = false;
+	}
+	if (root) {
+		if (!first) {
+			Append(",", 1);
+		}
+		Newline();
+		Indent(depth + 1);
+		Append(compact_ ? "\"root\":true" : "\"root\": true", compact_ ? 11 : 12);
+	}
+	Newline();
+	Indent(depth);
+	Append("}", 1);
+}
+
+void JSONWriter::Name(const char* name, size_t length) {
+	Indent(1);
+	Append("\"", 1);
+	Append(name, length);
+	Append(compact_ ? "\":" : "\": ", compact_ ? 2 : 3);
+}
+
+void JSONWriter::Item(size_t index, char open) {
+	Append(index == 0 ? &open : ",", 1);
+	Newline();
+}
+
+void JSONWriter::Close(size_t count, char open, char close) {
+	if (count == 0) {
+		Append(&open, 1);
+	} else {
+		Newline();
+		Indent(1);
+	}
+	Append(&close, 1);
+	Append(",", 1);
+	Newline();
+}
+
+void JSONWriter::WriteKeys(const char* name, size_t length, const std::vector<int>& keys) {
+	Name(name, length);
+	for (size_t i = 0; i < keys.size(); i++) {
+		Item(i, '[');
+		Indent(2);
+		AppendInt(keys[i]);
+	}
+	Close(keys.size(), '[', ']');
+}
+
+void JSONWriter::ResetFlag() {
+	Name("reset", 5);
+	Append("true,", 5);
+	Newline();
+}
+
+void JSONWriter::End(const int* root, size_t size) {
+	if (root != nullptr) {
+		Indent(1);
+		Append(compact_ ? "\"root\":" : "\"root\": ", compact_ ? 7 : 8);
+		AppendInt(*root);
+		Append(compact_ ? "," : ",\n", compact_ ? 1 : 2);
+	}
+	Indent(1);
+	Append(compact_ ? "\"size\":" : "\"size\": ", compact_ ? 7 : 8);
+	AppendUnsigned(size);
+	Append(compact_ ? "}\n" : "\n}\n", compact_ ? 2 : 3);
+}
+
+void JSONWriter::Field(int depth, const char* name, size_t length, long long value, bool first) {
+	if (!first) {
+		Append(",", 1);
+	}
+	Newline();
+	Indent(depth);
+	Append("\"", 1);
+	Append(name, length);
+	Append(compact_ ? "\":" : "\": ", compact_ ? 2 : 3);
+	AppendInt(value);
+}
+
+void JSONWriter::Append(const char* text, size_t length) {
+	if (kBufferSize - used_ < length) {
+		Flush();
+	}
+	std::memcpy(buffer_.get() + used_, text, length);
+	used_ += length;
+}
+
+void JSONWriter::AppendBlock(const char* text, size_t length) {
+	if (length <= kBufferSize) {
+		Append(text, length);
+	} else {
+		// copying it through buffer_ gains nothing
+		Flush();
+		Output(text, length);
+	}
+}
+
+void JSONWriter::AppendInt(long long value) {
+	if (value < 0) {
+		Append("-", 1);
+		AppendUnsigned(0ull - static_cast<unsigned long long>(value));
+	} else {
+		AppendUnsigned(value);
+	}
+}
+
+void JSONWriter::AppendUnsigned(unsigned long long value) {
+	// fill from the back, two digits at a time
+	char digits[20];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+	while (value >= 100) {
+		unsigned pair = static_cast<unsigned>(value % 100) * 2;
+		value /= 100;
+		*--begin = kDigitPairs[pair + 1];
+		*--begin = kDigitPairs[pair];
+	}
+	if (value >= 10) {
+		unsigned pair = static_cast<unsigned>(value) * 2;
+		*--begin = kDigitPairs[pair + 1];
+		*--begin = kDigitPairs[pair];
+	} else {
+		*--begin = static_cast<char>('0' + value);
+	}
+	Append(begin, end - begin);
+}
+
+void JSONWriter::Newline() {
+	if (!compact_) {
+		Append("\n", 1);
+	}
+}
+
+void JSONWriter::Indent(int levels) {
+	if (!compact_) {
+		Append("        ", 2 * levels);
+	}
+}
@@ -0,0 +1,376 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ForkJoinPool.h"
+#include "TreePartition.h"
+
+// Writes the JSON() schema of a BST or AVL tree straight to an ostream or
+// a file descriptor through one fixed 64 KiB buffer, without building a
+// document first, so memory stays constant however big the tree is.
+// Members come out in key order: one "key": {"left", "parent", "right",
+// "root"} object per key, then "root" and "size". The pretty form is
+// indented like nlohmann's dump(2); compact drops all whitespace except
+// the final newline. This parses to the same document that nlohmann's DOM
+// used to build, duplicate keys included: those had one member between
+// them, whose fields came from whichever node with the key set them last
+// breadth first, and KeyEntry merges them the same way.
+//
+// Big trees are written on the pool WriteTree is given: TreePartition cuts
+// them into subtrees that are rendered side by side into strings, a few
+// per thread at a time, and appended in key order, so the bytes are the
+// same as from one thread and only those few pieces are held at once.
+class JSONWriter {
+ public:
+	JSONWriter(std::ostream& out, bool compact);
+	JSONWriter(int fd, bool compact);
+	// appends to *out
+	JSONWriter(std::string* out, bool compact);
+	// flushes whatever is still buffered
+	~JSONWriter();
+	JSONWriter(const JSONWriter&) = delete;
+	JSONWriter& operator=(const JSONWriter&) = delete;
+
+	template <class Node>
+	void WriteTree(const Node* root, size_t size, ForkJoinPool& pool);
+	// the patch from the document at the last checkpoint to the tree at
+	// root, see ChangeLog.h: "created" and "modified" hold entries like
+	// JSON()'s for the keys of the nodes listed, sorted by key, "removed"
+	// the sorted keys that are gone. A removed or vanished key that still
+	// has copies in the tree is not gone, its merged entry is modified
+	// instead; a vanished one that is gone was never in the document. With
+	// reset every key of the tree counts as created. Every node listed
+	// costs O(height), and every key written the O(height) depth of each
+	// of its copies, see KeyEntry.
+	template <class Node>
+	void WriteDelta(const Node* root, size_t size, bool reset,
+		const std::vector<const Node*>& created, const std::vector<const Node*>& modified,
+		const std::vector<int>& removed, const std::vector<int>& vanished);
+	void Flush();
+
+ private:
+	static const size_t kBufferSize = 1 << 16;
+
+	// in-order neighbours through the parent links, null past either end
+	template <class Node>
+	static const Node* Next(const Node* node);
+	template <class Node>
+	static const Node* Previous(const Node* node);
+	template <class Node>
+	static int Depth(const Node* node);
+	// some node with key under root, null if there is none
+	template <class Node>
+	static const Node* Lookup(const Node* root, int key);
+	template <class Node>
+	void NodeEntry(int depth, const Node* node);
+	// the entry of node's key: node's own unless the nodes after it share
+	// the key, then all of theirs merged, which walks up from each of them
+	// for its depth: O(copies * height). Returns the node after them.
+	template <class Node>
+	const Node* KeyEntry(int depth, const Node* node);
+	// items of a delta member, one KeyEntry per key of the sorted nodes,
+	// each taken from the first node with that key; returns how many
+	template <class Node>
+	size_t KeyEntries(const std::vector<const Node*>& nodes);
+	// a member of the outermost object, as WriteTree writes it, for the
+	// key of node; returns the node with the next key
+	template <class Node>
+	const Node* TreeEntry(const Node* node);
+	template <class Node>
+	void WritePieces(const TreePartition<Node>& partition, ForkJoinPool& pool);
+
+	void Begin();
+	// left, parent and right are null when absent
+	void Entry(int depth, int key, const int* left, const int* parent, const int* right, bool root);
+	void End(const int* root, size_t size);
+	void Field(int depth, const char* name, size_t length, long long value, bool first);
+	// "name": of a member of the outermost object
+	void Name(const char* name, size_t length);
+	// opens an object or array with open before item 0, separates later
+	// items from the one before
+	void Item(size_t index, char open);
+	// ends a member of the outermost object that had count items, an
+	// empty one comes out as {} or []
+	void Close(size_t count, char open, char close);
+	void WriteKeys(const char* name, size_t length, const std::vector<int>& keys);
+	void ResetFlag();
+	void Newline();
+	// sends length bytes on to the stream, fd or string, bypassing buffer_
+	void Output(const char* data, size_t length);
+	void Append(const char* text, size_t length);
+	// like Append, for text that may not fit in buffer_ at all
+	void AppendBlock(const char* text, size_t length);
+	void AppendInt(long long value);
+	void AppendUnsigned(unsigned long long value);
+	void Indent(int levels);
+
+	std::unique_ptr<char[]> buffer_;
+	size_t used_;
+	std::ostream* stream_;
+	std::string* string_;
+	int fd_;
+	bool compact_;
+}; // class JSONWriter
+
+template <class Node>
+void JSONWriter::WriteTree(const Node* root, size_t size, ForkJoinPool& pool) {
+	Begin();
+	TreePartition<Node> partition(root, (pool.size() > 1) ? size : 0);
+	if (partition.size() > 1) {
+		WritePieces(partition, pool);
+	} else {
+		const Node* node = root;
+		while (node != nullptr && node->left_ != nullptr) {
+			node = node->left_;
+		}
+		while (node != nullptr) {
+			node = TreeEntry(node);
+		}
+	}
+	End((root != nullptr) ? &root->key_ : nullptr, size);
+}
+
+template <class Node>
+void JSONWriter::WriteDelta(const Node* root, size_t size, bool reset,
+		const std::vector<const Node*>& created, const std::vector<const Node*>& modified,
+		const std::vector<int>& removed, const std::vector<int>& vanished) {
+	Begin();
+	size_t count = 0;
+	Name("created", 7);
+	if (reset) {
+		const Node* node = root;
+		while (node != nullptr && node->left_ != nullptr) {
+			node = node->left_;
+		}
+		while (node != nullptr) {
+			Item(count++, '{');
+			node = KeyEntry(2, node);
+		}
+	} else {
+		count = KeyEntries(created);
+	}
+	Close(count, '{', '}');
+	// a key that lost a node but has copies left changes their merged
+	// entry instead
+	std::vector<const Node*> remaining;
+	std::vector<int> gone;
+	for (int key : removed) {
+		const Node* node = Lookup(root, key);
+		if (node != nullptr) {
+			remaining.push_back(node);
+		} else {
+			gone.push_back(key);
+		}
+	}
+	for (int key : vanished) {
+		const Node* node = Lookup(root, key);
+		if (node != nullptr) {
+			remaining.push_back(node);
+		}
+	}
+	// the subtrees a rotation or an unlink moved to another depth hang off
+	// nodes it changed. Copies of a key on both sides of the edge of such a
+	// subtree may now come in another breadth-first order, which changes
+	// their merged entry though none of them is listed.
+	if (!reset) {
+		for (const std::vector<const Node*>* listed : {&created, &modified}) {
+			for (const Node* node : *listed) {
+				for (const Node* child : {node->left_, node->right_}) {
+					if (child == nullptr) {
+						continue;
+					}
+					const Node* low = child;
+					while (low->left_ != nullptr) {
+						low = low->left_;
+					}
+					const Node* before = Previous(low);
+					if (before != nullptr && before->key_ == low->key_) {
+						remaining.push_back(low);
+					}
+					const Node* high = child;
+					while (high->right_ != nullptr) {
+						high = high->right_;
+					}
+					const Node* after = Next(high);
+					if (after != nullptr && after->key_ == high->key_) {
+						remaining.push_back(high);
+					}
+				}
+			}
+		}
+	}
+	auto byKey = [](const Node* a, const Node* b) { return a->key_ < b->key_; };
+	std::sort(remaining.begin(), remaining.end(), byKey);
+	Name("modified", 8);
+	if (remaining.empty()) {
+		count = KeyEntries(modified);
+	} else {
+		std::vector<const Node*> changed;
+		std::merge(modified.begin(), modified.end(), remaining.begin(), remaining.end(),
+			std::back_inserter(changed), byKey);
+		count = KeyEntries(changed);
+	}
+	Close(count, '{', '}');
+	WriteKeys("removed", 7, gone);
+	if (reset) {
+		ResetFlag();
+	}
+	End((root != nullptr) ? &root->key_ : nullptr, size);
+}
+
+template <class Node>
+const Node* JSONWriter::Next(const Node* node) {
+	if (node->right_ != nullptr) {
+		node = node->right_;
+		while (node->left_ != nullptr) {
+			node = node->left_;
+		}
+		return node;
+	}
+	while (node->parent_ != nullptr && node == node->parent_->right_) {
+		node = node->parent_;
+	}
+	return node->parent_;
+}
+
+template <class Node>
+const Node* JSONWriter::Previous(const Node* node) {
+	if (node->left_ != nullptr) {
+		node = node->left_;
+		while (node->right_ != nullptr) {
+			node = node->right_;
+		}
+		return node;
+	}
+	while (node->parent_ != nullptr && node == node->parent_->left_) {
+		node = node->parent_;
+	}
+	return node->parent_;
+}
+
+template <class Node>
+int JSONWriter::Depth(const Node* node) {
+	int depth = 0;
+	for (node = node->parent_; node != nullptr; node = node->parent_) {
+		depth++;
+	}
+	return depth;
+}
+
+template <class Node>
+const Node* JSONWriter::Lookup(const Node* root, int key) {
+	const Node* node = root;
+	while (node != nullptr && node->key_ != key) {
+		node = (key < node->key_) ? node->left_ : node->right_;
+	}
+	return node;
+}
+
+template <class Node>
+void JSONWriter::NodeEntry(int depth, const Node* node) {
+	Entry(depth, node->key_,
+		(node->left_ != nullptr) ? &node->left_->key_ : nullptr,
+		(node->parent_ != nullptr) ? &node->parent_->key_ : nullptr,
+		(node->right_ != nullptr) ? &node->right_->key_ : nullptr,
+		node->parent_ == nullptr);
+}
+
+template <class Node>
+const Node* JSONWriter::KeyEntry(int depth, const Node* node) {
+	const Node* next = Next(node);
+	if (next == nullptr || next->key_ != node->key_) {
+		NodeEntry(depth, node);
+		return next;
+	}
+	// equal keys are adjacent in key order. Breadth first they come by
+	// depth and then in key order, so of the nodes that have a field the
+	// last one there is the deepest, and the last in key order among those.
+	int key = node->key_;
+	const int* fields[3] = {nullptr, nullptr, nullptr};
+	int depths[3] = {-1, -1, -1};
+	bool root = false;
+	for (; node != nullptr && node->key_ == key; node = Next(node)) {
+		int nodeDepth = Depth(node);
+		const Node* links[3] = {node->left_, node->parent_, node->right_};
+		for (int i = 0; i < 3; i++) {
+			if (links[i] != nullptr && nodeDepth >= depths[i]) {
+				fields[i] = &links[i]->key_;
+				depths[i] = nodeDepth;
+			}
+		}
+		root = root || node->parent_ == nullptr;
+	}
+	Entry(depth, key, fields[0], fields[1], fields[2], root);
+	return node;
+}
+
+template <class Node>
+size_t JSONWriter::KeyEntries(const std::vector<const Node*>& nodes) {
+	size_t count = 0;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (i > 0 && nodes[i]->key_ == nodes[i - 1]->key_) {
+			continue;
+		}
+		const Node* first = nodes[i];
+		const Node* previous = Previous(first);
+		while (previous != nullptr && previous->key_ == first->key_) {
+			first = previous;
+			previous = Previous(first);
+		}
+		Item(count++, '{');
+		KeyEntry(2, first);
+	}
+	return count;
+}
+
+template <class Node>
+const Node* JSONWriter::TreeEntry(const Node* node) {
+	node = KeyEntry(1, node);
+	// "root" or "size" always follows, so every entry takes a comma
+	Append(",", 1);
+	Newline();
+	return node;
+}
+
+template <class Node>
+void JSONWriter::WritePieces(const TreePartition<Node>& partition, ForkJoinPool& pool) {
+	// enough pieces per wave that a slow one does not idle the others
+	size_t wave = 4 * pool.size();
+	std::vector<std::string> texts(wave);
+	for (size_t first = 0; first < partition.size(); first += wave) {
+		size_t last = std::min(partition.size(), first + wave);
+		auto work = [&](size_t i) {
+			std::string& text = texts[i - first];
+			text.clear();
+			JSONWriter writer(&text, compact_);
+			// a piece writes the keys that start in it, a run of equal keys
+			// that crosses into the next piece included
+			const Node* node = partition.First(i);
+			const Node* end = (i + 1 < partition.size()) ? partition.First(i + 1) : nullptr;
+			const Node* previous = Previous(node);
+			while (node != end && previous != nullptr && node->key_ == previous->key_) {
+				node = Next(node);
+			}
+			while (node != end) {
+				bool last = (end != nullptr && node->key_ == end->key_);
+				node = writer.TreeEntry(node);
+				if (last) {
+					break;
+				}
+			}
+		};
+		TreePartition<Node>::Fork(pool, first, last, work);
+		for (size_t i = first; i < last; i++) {
+			AppendBlock(texts[i - first].data(), texts[i - first].size());
+		}
+	}
+}
+
+#endif // JSONWRITER_H
@@ -0,0 +1,157 @@
+#include "MappedAVL.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char MappedAVL::kMagic[8] = {'A', 'V', 'L', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t MappedAVL::kVersion;
+const uint64_t SnapshotChecksum::kModulus;
+
+SnapshotChecksum::SnapshotChecksum() : sum_(0), sumOfSums_(0), partialLength_(0) {}
+
+void SnapshotChecksum::Update(const void* data, size_t length) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	while (partialLength_ != 0 && length != 0) {
+		partial_[partialLength_++] = *bytes++;
+		length--;
+		if (partialLength_ == sizeof(uint32_t)) {
+			uint32_t word;
+			std::memcpy(&word, partial_, sizeof(word));
+			AddWord(word);
+			partialLength_ = 0;
+		}
+	}
+	for (; length >= sizeof(uint32_t); bytes += sizeof(uint32_t), length -= sizeof(uint32_t)) {
+		uint32_t word;
+		std::memcpy(&word, bytes, sizeof(word));
+		AddWord(word);
+	}
+	// an empty tree hands over null data
+	if (length != 0) {
+		std::memcpy(partial_ + partialLength_, bytes, length);
+		partialLength_ += length;
+	}
+}
+
+uint64_t SnapshotChecksum::Value() const {
+	SnapshotChecksum copy(*this);
+	if (copy.partialLength_ != 0) {
+		uint32_t word = 0;
+		std::memcpy(&word, copy.partial_, copy.partialLength_);
+		copy.AddWord(word);
+	}
+	return (copy.sumOfSums_ << 32) | copy.sum_;
+}
+
+void SnapshotChecksum::AddWord(uint32_t word) {
+	// both sums stay below kModulus, so one subtraction reduces each
+	sum_ += word;
+	if (sum_ >= kModulus) {
+		sum_ -= kModulus;
+	}
+	sumOfSums_ += sum_;
+	if (sumOfSums_ >= kModulus) {
+		sumOfSums_ -= kModulus;
+	}
+}
+
+MappedAVL::MappedAVL(const std::string& path, bool verify) :
+	map_(MAP_FAILED),
+	length_(0),
+	count_(0),
+	keys_(nullptr),
+	heights_(nullptr) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		Fail(path, std::strerror(errno));
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		Fail(path, std::strerror(errno));
+	}
+	length_ = status.st_size;
+	if (length_ < sizeof(MappedAVLHeader)) {
+		Fail(path, "too short for a header");
+	}
+	map_ = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map_ == MAP_FAILED) {
+		Fail(path, std::strerror(errno));
+	}
+	const MappedAVLHeader* header = static_cast<const MappedAVLHeader*>(map_);
+	if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+		Fail(path, "not an AVL snapshot");
+	}
+	if (header->version != kVersion || header->headerSize != sizeof(MappedAVLHeader)) {
+		Fail(path, "unsupported snapshot version");
+	}
+	count_ = header->count;
+	if (count_ > (length_ - sizeof(MappedAVLHeader)) / (sizeof(int) + 1) ||
+			length_ != sizeof(MappedAVLHeader) + count_ * (sizeof(int) + 1)) {
+		Fail(path, "size does not match the key count");
+	}
+	const char* payload = static_cast<const char*>(map_) + sizeof(MappedAVLHeader);
+	keys_ = reinterpret_cast<const int*>(payload);
+	heights_ = reinterpret_cast<const uint8_t*>(payload + count_ * sizeof(int));
+	if (verify) {
+		SnapshotChecksum checksum;
+		checksum.Update(payload, count_ * (sizeof(int) + 1));
+		if (checksum.Value() != header->checksum) {
+			Fail(path, "checksum mismatch");
+		}
+	}
+}
+
+MappedAVL::~MappedAVL() {
+	if (map_ != MAP_FAILED) {
+		munmap(map_, length_);
+	}
+}
+
+bool MappedAVL::Find(int key) const {
+	return std::binary_search(keys_, keys_ + count_, key);
+}
+
+size_t MappedAVL::size() const {
+	return count_;
+}
+
+bool MappedAVL::empty() const {
+	return count_ == 0;
+}
+
+size_t MappedAVL::Rank(int key) const {
+	return std::lower_bound(keys_, keys_ + count_, key) - keys_;
+}
+
+int MappedAVL::Select(size_t k) const {
+	if (k >= count_) {
+		std::cerr << "Select(" << k << ") on a MappedAVL of size " << count_ << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return keys_[k];
+}
+
+const int* MappedAVL::begin() const {
+	return keys_;
+}
+
+const int* MappedAVL::end() const {
+	return keys_ + count_;
+}
+
+const uint8_t* MappedAVL::heights() const {
+	return heights_;
+}
+
+void MappedAVL::Fail(const std::string& path, const char* reason) const {
+	std::cerr << "MappedAVL: " << path << ": " << reason << std::endl;
+	exit(EXIT_FAILURE);
+}
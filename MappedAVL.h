@@ -0,0 +1,82 @@
+#ifndef MAPPEDAVL_H
+#define MAPPEDAVL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary snapshot written by AVL::Save, in host byte order:
+//
+//   MappedAVLHeader       32 bytes
+//   int32_t  keys[count]  in order
+//   uint8_t  heights[count], height of the node holding keys[i]
+//
+// In-order keys plus heights pin down the exact shape of the tree, see
+// AVL::Load. The checksum covers keys and heights, as one byte stream.
+struct MappedAVLHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t count;
+	uint64_t checksum;
+};
+
+// Fletcher-64, fed in pieces of any length: both sums run over 32-bit
+// words modulo 2^32 - 1, so changing any one byte changes the word sum
+// and every single-byte error is caught, however the bytes line up
+class SnapshotChecksum {
+ public:
+	SnapshotChecksum();
+	void Update(const void* data, size_t length);
+	// pads a trailing partial word with zeroes
+	uint64_t Value() const;
+
+ private:
+	static const uint64_t kModulus = 0xffffffffull;
+
+	void AddWord(uint32_t word);
+
+	uint64_t sum_;
+	uint64_t sumOfSums_;
+	// bytes of a word not completed by the last Update
+	unsigned char partial_[4];
+	size_t partialLength_;
+}; // class SnapshotChecksum
+
+// A snapshot mapped read-only into memory. The sorted key array in the
+// file is searched in place, so opening one costs an mmap and, with
+// verify, one pass over the file for the checksum, with no parsing and no
+// allocation per key.
+class MappedAVL {
+ public:
+	static const char kMagic[8];
+	static const uint32_t kVersion = 2;
+
+	// exits with a message if path is not a valid snapshot
+	explicit MappedAVL(const std::string& path, bool verify = true);
+	~MappedAVL();
+	MappedAVL(const MappedAVL&) = delete;
+	MappedAVL& operator=(const MappedAVL&) = delete;
+
+	bool Find(int key) const;
+	size_t size() const;
+	bool empty() const;
+	// same meaning as AVL::Rank and AVL::Select
+	size_t Rank(int key) const;
+	int Select(size_t k) const;
+	// the keys in order, and the height of each one's node
+	const int* begin() const;
+	const int* end() const;
+	const uint8_t* heights() const;
+
+ private:
+	void Fail(const std::string& path, const char* reason) const;
+
+	void* map_;
+	size_t length_;
+	size_t count_;
+	const int* keys_;
+	const uint8_t* heights_;
+}; // class MappedAVL
+
+#endif // MAPPEDAVL_H
@@ -0,0 +1,236 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Slab allocator that owns every node of one tree. Nodes are carved out of
+// large slabs and recycled through an intrusive free list, so after warm-up
+// Insert/Delete churn does no heap allocation at all. Destroying the pool
+// releases the slabs wholesale without visiting the nodes, which is why T
+// has to be trivially destructible.
+//
+// The slabs a pool grows into form one reference-counted group. When trees
+// are split and joined their nodes end up spread over several groups, and
+// each pool keeps a flat set of the other groups its nodes may live in, so
+// a group is released once no pool keeps it and a pool is never more than
+// one step away from the memory it hands out.
+template <class T>
+class NodePool {
+ public:
+	NodePool();
+	~NodePool();
+	NodePool(const NodePool&) = delete;
+	NodePool& operator=(const NodePool&) = delete;
+	NodePool(NodePool&& other);
+	NodePool& operator=(NodePool&& other);
+
+	template <class... Args>
+	T* Allocate(Args&&... args);
+	void Free(T* node);
+	// makes sure the next n Allocate calls are served from one slab
+	void Reserve(size_t n);
+	// drops every node at once, the pool is empty and reusable afterwards
+	void Clear();
+	// keeps every slab other can hand out nodes from alive for as long as
+	// this pool lives, so nodes carved from other can be linked into (and
+	// freed through) this pool's tree. Used by Split to share the slabs of
+	// the tree being split between its halves. O(kept groups).
+	void Keep(const NodePool& other);
+	// Keep, and takes over other's free list as well; used when Join
+	// splices together trees from different pools. O(kept groups).
+	void Adopt(NodePool& other);
+
+ private:
+	union Slot {
+		Slot* next;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+	};
+	struct Slab {
+		Slab* next;
+		size_t capacity;
+		// the slots start at the first multiple of alignof(Slot) after the
+		// header, Grow over-allocates by that much for over-aligned T
+		Slot* Slots() {
+			uintptr_t address = reinterpret_cast<uintptr_t>(this + 1);
+			address = (address + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+			return reinterpret_cast<Slot*>(address);
+		}
+	};
+	// the slabs one pool has grown, released together with the last pool
+	// that keeps them
+	struct Group {
+		Group() : slabs(nullptr) {}
+		~Group() {
+			while (slabs != nullptr) {
+				Slab* next = slabs->next;
+				::operator delete(slabs);
+				slabs = next;
+			}
+		}
+		Group(const Group&) = delete;
+		Group& operator=(const Group&) = delete;
+
+		Slab* slabs;
+	};
+	static_assert(std::is_trivially_destructible<T>::value,
+		"NodePool releases slabs without running node destructors");
+
+	static const size_t kFirstSlab = 64;
+	static const size_t kMaxSlab = 65536;
+
+	void Grow(size_t capacity);
+
+	// grown on first use
+	std::shared_ptr<Group> group_;
+	Slot* free_;
+	// last slot of the free list, for splicing it onto another in O(1)
+	Slot* freeTail_;
+	// bump region inside the newest slab that has never been handed out
+	Slot* next_;
+	Slot* end_;
+	size_t nextCapacity_;
+	// every other group this pool's nodes may live in, sorted and unique
+	std::vector< std::shared_ptr<Group> > kept_;
+}; // class NodePool
+
+template <class T>
+NodePool<T>::NodePool() :
+	free_(nullptr),
+	freeTail_(nullptr),
+	next_(nullptr),
+	end_(nullptr),
+	nextCapacity_(kFirstSlab) {}
+
+template <class T>
+NodePool<T>::~NodePool() {
+	Clear();
+}
+
+template <class T>
+NodePool<T>::NodePool(NodePool&& other) :
+	group_(std::move(other.group_)),
+	free_(other.free_),
+	freeTail_(other.freeTail_),
+	next_(other.next_),
+	end_(other.end_),
+	nextCapacity_(other.nextCapacity_),
+	kept_(std::move(other.kept_)) {
+	other.free_ = other.freeTail_ = other.next_ = other.end_ = nullptr;
+	other.nextCapacity_ = kFirstSlab;
+}
+
+template <class T>
+NodePool<T>& NodePool<T>::operator=(NodePool&& other) {
+	if (this != &other) {
+		Clear();
+		std::swap(group_, other.group_);
+		std::swap(free_, other.free_);
+		std::swap(freeTail_, other.freeTail_);
+		std::swap(next_, other.next_);
+		std::swap(end_, other.end_);
+		std::swap(nextCapacity_, other.nextCapacity_);
+		std::swap(kept_, other.kept_);
+	}
+	return *this;
+}
+
+template <class T>
+template <class... Args>
+T* NodePool<T>::Allocate(Args&&... args) {
+	Slot* slot;
+	if (free_ != nullptr) {
+		slot = free_;
+		free_ = free_->next;
+	} else {
+		if (next_ == end_) {
+			Grow(nextCapacity_);
+			if (nextCapacity_ < kMaxSlab) {
+				nextCapacity_ *= 2;
+			}
+		}
+		slot = next_++;
+	}
+	return new (&slot->storage) T(std::forward<Args>(args)...);
+}
+
+template <class T>
+void NodePool<T>::Free(T* node) {
+	Slot* slot = reinterpret_cast<Slot*>(node);
+	if (free_ == nullptr) {
+		freeTail_ = slot;
+	}
+	slot->next = free_;
+	free_ = slot;
+}
+
+template <class T>
+void NodePool<T>::Reserve(size_t n) {
+	if (static_cast<size_t>(end_ - next_) < n) {
+		// whatever is left of the current bump region stays unused
+		Grow(n);
+	}
+}
+
+template <class T>
+void NodePool<T>::Clear() {
+	// groups other pools still keep outlive this one
+	group_.reset();
+	free_ = freeTail_ = next_ = end_ = nullptr;
+	nextCapacity_ = kFirstSlab;
+	kept_.clear();
+}
+
+template <class T>
+void NodePool<T>::Keep(const NodePool& other) {
+	if (&other == this) {
+		return;
+	}
+	kept_.insert(kept_.end(), other.kept_.begin(), other.kept_.end());
+	if (other.group_ != nullptr) {
+		kept_.push_back(other.group_);
+	}
+	std::sort(kept_.begin(), kept_.end());
+	kept_.erase(std::unique(kept_.begin(), kept_.end()), kept_.end());
+	if (group_ != nullptr) {
+		kept_.erase(std::remove(kept_.begin(), kept_.end(), group_), kept_.end());
+	}
+}
+
+template <class T>
+void NodePool<T>::Adopt(NodePool& other) {
+	if (&other == this) {
+		return;
+	}
+	Keep(other);
+	if (other.free_ != nullptr) {
+		other.freeTail_->next = free_;
+		if (free_ == nullptr) {
+			freeTail_ = other.freeTail_;
+		}
+		free_ = other.free_;
+		other.free_ = other.freeTail_ = nullptr;
+	}
+}
+
+template <class T>
+void NodePool<T>::Grow(size_t capacity) {
+	if (group_ == nullptr) {
+		group_ = std::make_shared<Group>();
+	}
+	void* memory = ::operator new(sizeof(Slab) + alignof(Slot) + capacity * sizeof(Slot));
+	Slab* slab = static_cast<Slab*>(memory);
+	slab->next = group_->slabs;
+	slab->capacity = capacity;
+	group_->slabs = slab;
+	next_ = slab->Slots();
+	end_ = next_ + capacity;
+}
+
+#endif // NODEPOOL_H
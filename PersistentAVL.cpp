@@ -0,0 +1,195 @@
+#include "PersistentAVL.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <utility>
+
+#include "json.hpp"
+
+PersistentAVLNode::PersistentAVLNode(int key, Ptr left, Ptr right) :
+	key_(key),
+	height_(1 + std::max(left ? left->height_ : -1, right ? right->height_ : -1)),
+	size_(1 + (left ? left->size_ : 0) + (right ? right->size_ : 0)),
+	left_(std::move(left)),
+	right_(std::move(right)) {}
+
+PersistentAVL::PersistentAVL() {}
+
+PersistentAVL::PersistentAVL(const PersistentAVL& other) : root_(other.Root()) {}
+
+PersistentAVL& PersistentAVL::operator=(const PersistentAVL& other) {
+	if (this != &other) {
+		Publish(other.Root());
+	}
+	return *this;
+}
+
+void PersistentAVL::Insert(int key) {
+	Publish(Insert(root_, key));
+}
+
+bool PersistentAVL::Delete(int key) {
+	Ptr root = Delete(root_, key);
+	if (root == root_) {
+		return false;
+	}
+	Publish(std::move(root));
+	return true;
+}
+
+bool PersistentAVL::Find(int key) const {
+	Ptr root = Root();
+	const Node* currentNode = root.get();
+	while (currentNode != nullptr) {
+		if (currentNode->key_ == key) {
+			return true;
+		}
+		currentNode = (key < currentNode->key_) ?
+			currentNode->left_.get() : currentNode->right_.get();
+	}
+	return false;
+}
+
+std::string PersistentAVL::JSON() const {
+	nlohmann::json result;
+	Ptr root = Root();
+	// nodes know no parent, so it travels along in the queue
+	std::queue< std::pair<const Node*, const Node*> > nodes;
+	if (root != nullptr) {
+		result["root"] = root->key_;
+		nodes.push(std::make_pair(root.get(), nullptr));
+		while (!nodes.empty()) {
+			const Node* v = nodes.front().first;
+			const Node* parent = nodes.front().second;
+			nodes.pop();
+			std::string key = std::to_string(v->key_);
+			if (v->left_ != nullptr) {
+				result[key]["left"] = v->left_->key_;
+				nodes.push(std::make_pair(v->left_.get(), v));
+			}
+			if (v->right_ != nullptr) {
+				result[key]["right"] = v->right_->key_;
+				nodes.push(std::make_pair(v->right_.get(), v));
+			}
+			if (parent != nullptr) {
+				result[key]["parent"] = parent->key_;
+			} else {
+				result[key]["root"] = true;
+			}
+		}
+	}
+	result["size"] = Size(root);
+	return result.dump(2) + "\n";
+}
+
+size_t PersistentAVL::size() const {
+	return Size(Root());
+}
+
+bool PersistentAVL::empty() const {
+	return Root() == nullptr;
+}
+
+int PersistentAVL::DeleteMin() {
+	if (root_ == nullptr) {
+		std::cerr << "DeleteMin called on an empty PersistentAVL" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	int key;
+	Publish(DeleteMin(root_, &key));
+	return key;
+}
+
+PersistentAVL PersistentAVL::Snapshot() const {
+	return *this;
+}
+
+int PersistentAVL::Height(const Ptr& node) {
+	return (node == nullptr) ? -1 : node->height_;
+}
+
+size_t PersistentAVL::Size(const Ptr& node) {
+	return (node == nullptr) ? 0 : node->size_;
+}
+
+PersistentAVL::Ptr PersistentAVL::Make(int key, Ptr left, Ptr right) {
+	return std::make_shared<const Node>(key, std::move(left), std::move(right));
+}
+
+PersistentAVL::Ptr PersistentAVL::Balance(int key, Ptr left, Ptr right) {
+	int balance = Height(right) - Height(left);
+	if (balance > 1) {
+		if (Height(right->left_) > Height(right->right_)) {
+			// right-left: right->left_ comes up two levels
+			const Ptr& middle = right->left_;
+			return Make(middle->key_,
+				Make(key, std::move(left), middle->left_),
+				Make(right->key_, middle->right_, right->right_));
+		}
+		return Make(right->key_,
+			Make(key, std::move(left), right->left_), right->right_);
+	}
+	if (balance < -1) {
+		if (Height(left->right_) > Height(left->left_)) {
+			const Ptr& middle = left->right_;
+			return Make(middle->key_,
+				Make(left->key_, left->left_, middle->left_),
+				Make(key, middle->right_, std::move(right)));
+		}
+		return Make(left->key_,
+			left->left_, Make(key, left->right_, std::move(right)));
+	}
+	return Make(key, std::move(left), std::move(right));
+}
+
+PersistentAVL::Ptr PersistentAVL::Insert(const Ptr& node, int key) {
+	if (node == nullptr) {
+		return Make(key, nullptr, nullptr);
+	}
+	if (key < node->key_) {
+		return Balance(node->key_, Insert(node->left_, key), node->right_);
+	}
+	return Balance(node->key_, node->left_, Insert(node->right_, key));
+}
+
+PersistentAVL::Ptr PersistentAVL::Delete(const Ptr& node, int key) {
+	if (node == nullptr) {
+		return node;
+	}
+	if (key < node->key_) {
+		Ptr left = Delete(node->left_, key);
+		return (left == node->left_) ? node : Balance(node->key_, std::move(left), node->right_);
+	}
+	if (node->key_ < key) {
+		Ptr right = Delete(node->right_, key);
+		return (right == node->right_) ? node : Balance(node->key_, node->left_, std::move(right));
+	}
+	if (node->left_ == nullptr) {
+		return node->right_;
+	}
+	if (node->right_ == nullptr) {
+		return node->left_;
+	}
+	// the successor takes the place of the deleted key
+	int successor;
+	Ptr right = DeleteMin(node->right_, &successor);
+	return Balance(successor, node->left_, std::move(right));
+}
+
+PersistentAVL::Ptr PersistentAVL::DeleteMin(const Ptr& node, int* key) {
+	if (node->left_ == nullptr) {
+		*key = node->key_;
+		return node->right_;
+	}
+	return Balance(node->key_, DeleteMin(node->left_, key), node->right_);
+}
+
+PersistentAVL::Ptr PersistentAVL::Root() const {
+	return std::atomic_load(&root_);
+}
+
+void PersistentAVL::Publish(Ptr root) {
+	std::atomic_store(&root_, std::move(root));
+}
@@ -0,0 +1,73 @@
+#ifndef PERSISTENTAVL_H
+#define PERSISTENTAVL_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+class PersistentAVL;
+
+// Immutable once built; versions of the tree share every node that an
+// update did not touch.
+class PersistentAVLNode {
+ public:
+ 	typedef std::shared_ptr<const PersistentAVLNode> Ptr;
+
+ 	PersistentAVLNode(int key, Ptr left, Ptr right);
+
+ private:
+  const int key_;
+  const int height_;
+  // keys in this subtree, so size() of any version is O(1)
+  const size_t size_;
+  const Ptr left_;
+  const Ptr right_;
+
+  friend PersistentAVL;
+}; // class PersistentAVLNode
+
+// Path-copying AVL multiset of ints. Insert and Delete build new copies of
+// the O(log n) nodes on the path they change and share the rest with the
+// previous version, which stays intact for anyone still holding it.
+// Snapshot() is O(1) and may be called from any thread while the owner
+// keeps updating, a snapshot never blocks or observes later updates.
+class PersistentAVL {
+ public:
+ 	PersistentAVL();
+ 	// copies share every node, which is exactly what Snapshot() returns
+ 	PersistentAVL(const PersistentAVL& other);
+ 	PersistentAVL& operator=(const PersistentAVL& other);
+
+ 	void Insert(int key);
+ 	bool Delete(int key);
+ 	bool Find(int key) const;
+ 	std::string JSON() const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+ 	// the current version, later updates to this tree do not show in it
+ 	PersistentAVL Snapshot() const;
+
+ private:
+	typedef PersistentAVLNode Node;
+	typedef Node::Ptr Ptr;
+
+	static int Height(const Ptr& node);
+	static size_t Size(const Ptr& node);
+	static Ptr Make(int key, Ptr left, Ptr right);
+	// Make with the AVL rotations applied, left and right are balanced and
+	// differ in height by at most 2
+	static Ptr Balance(int key, Ptr left, Ptr right);
+	static Ptr Insert(const Ptr& node, int key);
+	// node itself when key is absent, nothing is copied then
+	static Ptr Delete(const Ptr& node, int key);
+	static Ptr DeleteMin(const Ptr& node, int* key);
+	// the root is read and published atomically, so Snapshot() from another
+	// thread always sees a complete version
+	Ptr Root() const;
+	void Publish(Ptr root);
+
+	Ptr root_;
+}; // class PersistentAVL
+
+#endif // PERSISTENTAVL_H
@@ -0,0 +1,132 @@
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PersistentAVL.h"
+
+// also built with -fsanitize=thread by make tsan
+#define SAMPLE_SIZE 1000
+#define NUM_TESTS 200
+#define NUM_READERS 4
+
+// a version taken earlier, with what it held at the time
+struct Version {
+	PersistentAVL tree;
+	std::multiset<int> keys;
+	std::string json;
+};
+
+// the writer keeps T at exactly the keys [lo, hi), so any complete version
+// a reader gets is such a range too
+void Reader(const PersistentAVL& T, const std::atomic<bool>& done) {
+	while (!done.load()) {
+		PersistentAVL snapshot = T.Snapshot();
+		size_t size = snapshot.size();
+		if (size == 0) {
+			continue;
+		}
+		int lo = snapshot.DeleteMin();
+		int hi = lo + static_cast<int>(size);
+		assert(snapshot.size() == size - 1);
+		assert(!snapshot.Find(lo));
+		assert(size == 1 || snapshot.Find(hi - 1));
+		assert(size == 1 || snapshot.Find(lo + 1));
+		assert(!snapshot.Find(hi));
+	}
+}
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+	// small range, so deletes hit and keys repeat
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE);
+	std::uniform_int_distribution<int> op(0, 3);
+
+	std::cout << "Running tests..." << std::flush;
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		PersistentAVL T;
+		std::multiset<int> model;
+		std::vector<Version> versions;
+		for (size_t i = 0; i < SAMPLE_SIZE; i++) {
+			int x = unif(rng);
+			switch (op(rng)) {
+			case 0: {
+				bool deleted = T.Delete(x);
+				assert(deleted == (model.count(x) != 0));
+				if (deleted) {
+					model.erase(model.find(x));
+				}
+				break;
+			}
+			case 1:
+				if (!model.empty()) {
+					assert(T.DeleteMin() == *model.begin());
+					model.erase(model.begin());
+				}
+				break;
+			default:
+				T.Insert(x);
+				model.insert(x);
+			}
+			assert(T.Find(x) == (model.count(x) != 0));
+			assert(T.size() == model.size());
+			if (i % 100 == 0) {
+				versions.push_back(Version{T.Snapshot(), model, T.JSON()});
+			}
+		}
+		// later updates, to the tree or to other versions, left every
+		// version as it was taken
+		for (Version& version : versions) {
+			assert(version.tree.JSON() == version.json);
+			assert(version.tree.size() == version.keys.size());
+			for (int x = 0; x <= SAMPLE_SIZE; x++) {
+				assert(version.tree.Find(x) == (version.keys.count(x) != 0));
+			}
+			std::string live = T.JSON();
+			while (!version.tree.empty()) {
+				assert(version.tree.DeleteMin() == *version.keys.begin());
+				version.keys.erase(version.keys.begin());
+			}
+			assert(T.JSON() == live);
+		}
+		for (const Version& version : versions) {
+			assert(version.tree.empty());
+		}
+		while (!T.empty()) {
+			assert(T.DeleteMin() == *model.begin());
+			model.erase(model.begin());
+		}
+		assert(model.empty());
+		if (sample % (NUM_TESTS / 10) == 0) {
+			std::cout << "." << std::flush;
+		}
+	}
+	// snapshots from other threads while the owner keeps publishing
+	PersistentAVL T;
+	std::atomic<bool> done(false);
+	std::vector<std::thread> readers;
+	for (int i = 0; i < NUM_READERS; i++) {
+		readers.emplace_back(Reader, std::cref(T), std::cref(done));
+	}
+	int lo = 0;
+	int hi = 0;
+	for (size_t i = 0; i < 100 * SAMPLE_SIZE; i++) {
+		if (hi > lo && op(rng) == 0) {
+			assert(T.DeleteMin() == lo++);
+		} else {
+			T.Insert(hi++);
+		}
+	}
+	done.store(true);
+	for (std::thread& reader : readers) {
+		reader.join();
+	}
+	assert(T.size() == static_cast<size_t>(hi - lo));
+	std::cout << "Tests complete.\n";
+}
@@ -0,0 +1,117 @@
+#ifndef SANITYCHECK_H
+#define SANITYCHECK_H
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "ForkJoinPool.h"
+#include "TreePartition.h"
+#include "json.hpp"
+
+// Checks shared by AVLSanityCheck and BSTSanityCheck, written once against
+// the interface both trees have so the two cannot drift apart.
+
+// height of the subtree at key in a JSON() document with distinct keys
+int JSONHeight(const nlohmann::json& document, int key) {
+	const nlohmann::json& node = document[std::to_string(key)];
+	int height = 0;
+	for (const char* side : {"left", "right"}) {
+		if (node.count(side) != 0) {
+			height = std::max(height, 1 + JSONHeight(document, node[side].get<int>()));
+		}
+	}
+	return height;
+}
+
+// brings document, the JSON() of a tree at its last JSONDelta, up to date
+// with the next one: "removed", then "created" and "modified", then "root"
+// and "size"; a reset starts from nothing. Returns whether it was a reset.
+bool ApplyDelta(nlohmann::json& document, const std::string& patch) {
+	nlohmann::json delta = nlohmann::json::parse(patch);
+	bool reset = delta.count("reset") != 0;
+	if (reset) {
+		assert(delta["reset"] == true);
+		document = nlohmann::json::object();
+	}
+	for (const nlohmann::json& key : delta["removed"]) {
+		document.erase(std::to_string(key.get<int>()));
+	}
+	for (const char* part : {"created", "modified"}) {
+		for (auto it = delta[part].begin(); it != delta[part].end(); ++it) {
+			document[it.key()] = it.value();
+		}
+	}
+	if (delta.count("root") != 0) {
+		document["root"] = delta["root"];
+	} else {
+		document.erase("root");
+	}
+	document["size"] = delta["size"];
+	return reset;
+}
+
+// random updates in batches, small keys so copies merge into one entry;
+// after each the patched document is JSON() again
+template <class Tree>
+void UpdateAndPatch(Tree& T, nlohmann::json& document, std::mt19937_64& rng) {
+	std::uniform_int_distribution<int> unif(0, 100);
+	std::uniform_int_distribution<int> op(0, 5);
+	for (int batch = 0; batch < 20; batch++) {
+		for (int i = 0; i < 20; i++) {
+			int x = unif(rng);
+			switch (op(rng)) {
+			case 0:
+			case 1:
+				T.Delete(x);
+				break;
+			case 2:
+				if (!T.empty()) {
+					T.DeleteMin();
+				}
+				break;
+			default:
+				T.Insert(x);
+			}
+		}
+		std::string patch;
+		if (batch % 2 == 0) {
+			patch = T.JSONDelta();
+		} else {
+			std::ostringstream compact;
+			T.WriteJSONDelta(compact, true);
+			patch = compact.str();
+		}
+		assert(!ApplyDelta(document, patch));
+		assert(document == nlohmann::json::parse(T.JSON()));
+	}
+}
+
+// a tree of Tree past two pieces of Node, see TreePartition.h, holding
+// runs of equal keys that cross from one piece into the next
+template <class Tree, class Node>
+Tree ManyCopies(std::mt19937_64& rng) {
+	Tree T;
+	for (size_t i = 0; i < 300000; i++) {
+		T.Insert(static_cast<int>(rng() % 40000));
+	}
+	assert(T.size() > 2 * TreePartition<Node>::kPieceNodes);
+	return T;
+}
+
+// trees past two pieces are written in pieces, which a one-thread pool
+// never does: pretty and compact JSON must not depend on it
+template <class Tree, class Node>
+void CheckParallelJSON(const Tree& T, ForkJoinPool& one, ForkJoinPool& four) {
+	assert(T.size() > 2 * TreePartition<Node>::kPieceNodes);
+	assert(one.size() == 1 && four.size() == 4);
+	assert(T.JSON(four) == T.JSON(one));
+	std::ostringstream parallel, serial;
+	T.WriteJSON(parallel, true, four);
+	T.WriteJSON(serial, true, one);
+	assert(parallel.str() == serial.str());
+}
+
+#endif // SANITYCHECK_H
@@ -0,0 +1,266 @@
+#include "ShardedAVL.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "ForkJoinPool.h"
+#include "json.hpp"
+
+const size_t ShardedAVL::kMinShardSize;
+const size_t ShardedAVL::kRebalanceInterval;
+
+ShardedAVL::ShardedAVL(size_t shards) :
+	initialShards_(std::max<size_t>(1, shards)),
+	size_(0),
+	updates_(0) {
+	int64_t width = ((int64_t) INT_MAX - INT_MIN + 1) / initialShards_;
+	for (size_t i = 0; i < initialShards_; i++) {
+		bounds_.push_back((int) (INT_MIN + (int64_t) i * width));
+		shards_.emplace_back(new Shard());
+	}
+}
+
+void ShardedAVL::Insert(int key) {
+	bool split;
+	{
+		std::shared_lock<std::shared_timed_mutex> layout(layout_);
+		Shard& shard = *shards_[ShardOf(key)];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.tree.Insert(key);
+		size_++;
+		split = Oversized(shard.tree.size());
+	}
+	if (split) {
+		Rebalance();
+	}
+	NoteUpdates(1);
+}
+
+bool ShardedAVL::Delete(int key) {
+	bool deleted;
+	{
+		std::shared_lock<std::shared_timed_mutex> layout(layout_);
+		Shard& shard = *shards_[ShardOf(key)];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		deleted = shard.tree.Delete(key);
+	}
+	if (deleted) {
+		size_--;
+		NoteUpdates(1);
+	}
+	return deleted;
+}
+
+bool ShardedAVL::Find(int key) const {
+	std::shared_lock<std::shared_timed_mutex> layout(layout_);
+	const Shard& shard = *shards_[ShardOf(key)];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	return shard.tree.Find(key);
+}
+
+std::string ShardedAVL::JSON() const {
+	std::shared_lock<std::shared_timed_mutex> layout(layout_);
+	nlohmann::json result;
+	result["shards"] = nlohmann::json::array();
+	for (size_t i = 0; i < shards_.size(); i++) {
+		std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+		nlohmann::json shard;
+		shard["lower"] = bounds_[i];
+		shard["tree"] = nlohmann::json::parse(shards_[i]->tree.JSON());
+		result["shards"].push_back(shard);
+	}
+	result["size"] = size_.load();
+	return result.dump(2) + "\n";
+}
+
+size_t ShardedAVL::size() const {
+	return size_.load();
+}
+
+bool ShardedAVL::empty() const {
+	return size_.load() == 0;
+}
+
+int ShardedAVL::DeleteMin() {
+	bool found = false;
+	int result = 0;
+	{
+		std::shared_lock<std::shared_timed_mutex> layout(layout_);
+		for (size_t i = 0; i < shards_.size() && !found; i++) {
+			std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+			if (!shards_[i]->tree.empty()) {
+				result = shards_[i]->tree.DeleteMin();
+				found = true;
+			}
+		}
+	}
+	if (!found) {
+		std::cerr << "DeleteMin called on an empty ShardedAVL" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	size_--;
+	NoteUpdates(1);
+	return result;
+}
+
+void ShardedAVL::InsertMany(const int* keys, size_t count) {
+	std::atomic<bool> split(false);
+	{
+		std::shared_lock<std::shared_timed_mutex> layout(layout_);
+		Routing routing = Route(keys, count);
+		auto work = [&](size_t s) {
+			Shard& shard = *shards_[s];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			for (size_t i = routing.begin[s]; i < routing.begin[s + 1]; i++) {
+				shard.tree.Insert(routing.keys[i]);
+			}
+			if (Oversized(shard.tree.size())) {
+				split = true;
+			}
+		};
+		size_ += count;
+		ForkShards(routing, 0, shards_.size(), work);
+	}
+	if (split) {
+		Rebalance();
+	}
+	NoteUpdates(count);
+}
+
+void ShardedAVL::DeleteMany(const int* keys, size_t count, bool* out) {
+	std::atomic<size_t> deleted(0);
+	{
+		std::shared_lock<std::shared_timed_mutex> layout(layout_);
+		Routing routing = Route(keys, count);
+		auto work = [&](size_t s) {
+			Shard& shard = *shards_[s];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			size_t found = 0;
+			for (size_t i = routing.begin[s]; i < routing.begin[s + 1]; i++) {
+				out[routing.origin[i]] = shard.tree.Delete(routing.keys[i]);
+				found += out[routing.origin[i]];
+			}
+			deleted += found;
+		};
+		ForkShards(routing, 0, shards_.size(), work);
+	}
+	size_ -= deleted;
+	NoteUpdates(deleted);
+}
+
+void ShardedAVL::FindMany(const int* keys, size_t count, bool* out) const {
+	std::shared_lock<std::shared_timed_mutex> layout(layout_);
+	Routing routing = Route(keys, count);
+	std::unique_ptr<bool[]> found(new bool[count]);
+	auto work = [&](size_t s) {
+		const Shard& shard = *shards_[s];
+		size_t begin = routing.begin[s];
+		size_t end = routing.begin[s + 1];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.tree.FindMany(&routing.keys[begin], end - begin, &found[begin]);
+		}
+		for (size_t i = begin; i < end; i++) {
+			out[routing.origin[i]] = found[i];
+		}
+	};
+	ForkShards(routing, 0, shards_.size(), work);
+}
+
+void ShardedAVL::Rebalance() {
+	std::unique_lock<std::shared_timed_mutex> layout(layout_);
+	// split oversized shards at their median until none is left
+	for (size_t i = 0; i < shards_.size(); i++) {
+		while (Oversized(shards_[i]->tree.size())) {
+			AVL& tree = shards_[i]->tree;
+			int median = tree.Select(tree.size() / 2);
+			if (tree.Select(0) == median) {
+				// the lower half is all copies of one key, Split cannot
+				// separate them
+				break;
+			}
+			std::pair<AVL, AVL> halves = tree.Split(median);
+			tree = std::move(halves.first);
+			std::unique_ptr<Shard> upper(new Shard());
+			upper->tree = std::move(halves.second);
+			shards_.insert(shards_.begin() + i + 1, std::move(upper));
+			bounds_.insert(bounds_.begin() + i + 1, median);
+		}
+	}
+	// then join neighbours that together hold less than half a share
+	for (size_t i = 0; i + 1 < shards_.size(); ) {
+		AVL& lower = shards_[i]->tree;
+		AVL& upper = shards_[i + 1]->tree;
+		if (lower.size() + upper.size() < Target() / 2) {
+			lower = AVL::Join(std::move(lower), std::move(upper));
+			shards_.erase(shards_.begin() + i + 1);
+			bounds_.erase(bounds_.begin() + i + 1);
+		} else {
+			i++;
+		}
+	}
+}
+
+size_t ShardedAVL::ShardCount() const {
+	std::shared_lock<std::shared_timed_mutex> layout(layout_);
+	return shards_.size();
+}
+
+size_t ShardedAVL::ShardOf(int key) const {
+	return std::upper_bound(bounds_.begin(), bounds_.end(), key) - bounds_.begin() - 1;
+}
+
+ShardedAVL::Routing ShardedAVL::Route(const int* keys, size_t count) const {
+	// counting sort by shard, stable so each shard sees its keys in order
+	Routing routing;
+	std::vector<size_t> shardOf(count);
+	routing.begin.assign(shards_.size() + 1, 0);
+	for (size_t i = 0; i < count; i++) {
+		shardOf[i] = ShardOf(keys[i]);
+		routing.begin[shardOf[i] + 1]++;
+	}
+	for (size_t s = 0; s < shards_.size(); s++) {
+		routing.begin[s + 1] += routing.begin[s];
+	}
+	std::vector<size_t> next(routing.begin.begin(), routing.begin.end() - 1);
+	routing.keys.resize(count);
+	routing.origin.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		size_t slot = next[shardOf[i]]++;
+		routing.keys[slot] = keys[i];
+		routing.origin[slot] = i;
+	}
+	return routing;
+}
+
+template <class Work>
+void ShardedAVL::ForkShards(const Routing& routing, size_t first, size_t last, Work& work) const {
+	if (routing.begin[first] == routing.begin[last]) {
+		return;
+	}
+	if (last - first == 1) {
+		work(first);
+		return;
+	}
+	size_t middle = first + (last - first) / 2;
+	ForkJoinPool::Default().Invoke(
+		[&] { ForkShards(routing, first, middle, work); },
+		[&] { ForkShards(routing, middle, last, work); });
+}
+
+size_t ShardedAVL::Target() const {
+	return std::max(kMinShardSize, size_.load() / initialShards_);
+}
+
+bool ShardedAVL::Oversized(size_t shardSize) const {
+	return shardSize > 2 * Target();
+}
+
+void ShardedAVL::NoteUpdates(size_t count) {
+	size_t before = updates_.fetch_add(count);
+	if (before / kRebalanceInterval != (before + count) / kRebalanceInterval) {
+		Rebalance();
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef SHARDEDAVL_H
+#define SHARDEDAVL_H
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "AVL.h"
+
+// Ordered multiset of ints split into key ranges, each its own AVL behind
+// its own mutex, so updates to different ranges run in parallel. Shard i
+// holds the keys in [bounds_[i], bounds_[i + 1]). Batched calls bucket the
+// keys by shard and work the shards off on ForkJoinPool::Default().
+//
+// When a shard grows past twice its fair share it is Split at its median
+// (AVL::Select), and neighbours that together shrink below half of it are
+// Joined back into one; both take the layout lock exclusively, every other
+// call holds it shared. Iteration and DeleteMin walk the shards in key order, so they
+// see keys in global order.
+class ShardedAVL {
+ public:
+ 	// starts with shards equal-width ranges of the int key space, later
+ 	// splits and joins aim for shards keys of size() / shards each
+ 	explicit ShardedAVL(size_t shards = 16);
+ 	ShardedAVL(const ShardedAVL&) = delete;
+ 	ShardedAVL& operator=(const ShardedAVL&) = delete;
+
+ 	void Insert(int key);
+ 	bool Delete(int key);
+ 	bool Find(int key) const;
+ 	std::string JSON() const;
+ 	size_t size() const;
+ 	bool empty() const;
+ 	int DeleteMin();
+ 	// batched forms of the above, one task per shard touched
+ 	void InsertMany(const int* keys, size_t count);
+ 	void DeleteMany(const int* keys, size_t count, bool* out);
+ 	void FindMany(const int* keys, size_t count, bool* out) const;
+ 	// calls visit(key) for every key in ascending order; each shard is
+ 	// locked while it is visited
+ 	template <class Visitor>
+ 	void ForEach(Visitor visit) const;
+ 	// splits oversized shards and joins undersized neighbours
+ 	void Rebalance();
+ 	size_t ShardCount() const;
+
+ private:
+	struct Shard {
+		mutable std::mutex mutex;
+		AVL tree;
+	};
+	// keys of a batch grouped by shard, with where each came from
+	struct Routing {
+		std::vector<size_t> begin;
+		std::vector<int> keys;
+		std::vector<size_t> origin;
+	};
+
+	// no shard is split below this size, however skewed the load
+	static const size_t kMinShardSize = 1024;
+	// deletes only shrink shards, so joins are looked for every this many
+	// updates rather than on each one
+	static const size_t kRebalanceInterval = 65536;
+
+	size_t ShardOf(int key) const;
+	Routing Route(const int* keys, size_t count) const;
+	// runs work(shard) for every shard in [first, last) with keys to do
+	template <class Work>
+	void ForkShards(const Routing& routing, size_t first, size_t last, Work& work) const;
+	// fair share of keys per shard, for the shard count asked for
+	size_t Target() const;
+	bool Oversized(size_t shardSize) const;
+	// counts count updates, and rebalances when an interval is complete;
+	// called without the layout lock held
+	void NoteUpdates(size_t count);
+
+	// lower bound of each shard's range, bounds_[0] is INT_MIN
+	std::vector<int> bounds_;
+	std::vector< std::unique_ptr<Shard> > shards_;
+	size_t initialShards_;
+	std::atomic<size_t> size_;
+	std::atomic<size_t> updates_;
+	mutable std::shared_timed_mutex layout_;
+}; // class ShardedAVL
+
+template <class Visitor>
+void ShardedAVL::ForEach(Visitor visit) const {
+	std::shared_lock<std::shared_timed_mutex> layout(layout_);
+	for (const std::unique_ptr<Shard>& shard : shards_) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		for (int key : shard->tree) {
+			visit(key);
+		}
+	}
+}
+
+#endif // SHARDEDAVL_H
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ShardedAVL.h"
+
+// also built with -fsanitize=thread by make tsan
+#define SAMPLE_SIZE 20000
+#define NUM_TESTS 10
+#define NUM_THREADS 4
+#define BATCH_SIZE 500
+#define CHURN_CYCLES 100
+
+// thread t only ever touches keys k with k % NUM_THREADS == t, so its model
+// of them stays exact while the others update and rebalance around it
+void Worker(ShardedAVL& T, std::multiset<int>& model, int t, unsigned seed) {
+	std::mt19937_64 rng(seed);
+	// a narrow range, so the keys pile into a few of the initial shards
+	std::uniform_int_distribution<int> unif(0, SAMPLE_SIZE / NUM_THREADS);
+	std::uniform_int_distribution<int> op(0, 3);
+	std::vector<int> keys(BATCH_SIZE);
+	bool out[BATCH_SIZE];
+	for (size_t round = 0; round < SAMPLE_SIZE / BATCH_SIZE; round++) {
+		for (int& key : keys) {
+			key = unif(rng) * NUM_THREADS + t;
+		}
+		switch (op(rng)) {
+		case 0:
+			T.DeleteMany(keys.data(), keys.size(), out);
+			for (size_t i = 0; i < keys.size(); i++) {
+				auto found = model.find(keys[i]);
+				assert(out[i] == (found != model.end()));
+				if (out[i]) {
+					model.erase(found);
+				}
+			}
+			break;
+		case 1:
+			if (t == 0) {
+				T.Rebalance();
+			}
+			for (int key : keys) {
+				assert(T.Delete(key) == (model.count(key) != 0));
+				if (model.count(key) != 0) {
+					model.erase(model.find(key));
+				}
+			}
+			break;
+		default:
+			T.InsertMany(keys.data(), keys.size());
+			model.insert(keys.begin(), keys.end());
+		}
+		T.FindMany(keys.data(), keys.size(), out);
+		for (size_t i = 0; i < keys.size(); i++) {
+			assert(out[i] == (model.count(keys[i]) != 0));
+		}
+	}
+}
+
+// T holds exactly model, in order
+void CheckContents(const ShardedAVL& T, const std::multiset<int>& model) {
+	assert(T.size() == model.size());
+	std::vector<int> keys;
+	T.ForEach([&](int key) { keys.push_back(key); });
+	assert(std::vector<int>(model.begin(), model.end()) == keys);
+}
+
+// fill and drain over and over: every Rebalance splits the filled shards
+// at their medians and joins the drained ones back, which must cost the
+// same in the last cycle as in the first
+void CheckChurn(std::mt19937_64& rng) {
+	std::uniform_int_distribution<int> unif(0, 4 * SAMPLE_SIZE);
+	ShardedAVL T(4);
+	std::multiset<int> model;
+	std::vector<int> keys(SAMPLE_SIZE);
+	std::unique_ptr<bool[]> out(new bool[SAMPLE_SIZE]);
+	for (int cycle = 0; cycle < CHURN_CYCLES; cycle++) {
+		for (int& key : keys) {
+			key = unif(rng);
+		}
+		T.InsertMany(keys.data(), keys.size());
+		model.insert(keys.begin(), keys.end());
+		T.Rebalance();
+		assert(T.ShardCount() > 1);
+		// leave a few behind, so the drained shards are not all empty
+		std::vector<int> present(model.begin(), model.end());
+		std::shuffle(present.begin(), present.end(), rng);
+		present.resize(std::min(present.size() - present.size() / 32, keys.size()));
+		T.DeleteMany(present.data(), present.size(), out.get());
+		for (size_t i = 0; i < present.size(); i++) {
+			assert(out[i]);
+			model.erase(model.find(present[i]));
+		}
+		T.Rebalance();
+		if (cycle % 10 == 0) {
+			CheckContents(T, model);
+		}
+	}
+	CheckContents(T, model);
+}
+
+int main() {
+
+	// Seed random number generator
+	std::mt19937_64 rng(time(0));
+
+	std::cout << "Running tests..." << std::flush;
+	for (unsigned int sample = 0; sample < NUM_TESTS; sample++) {
+		ShardedAVL T(4);
+		std::vector< std::multiset<int> > models(NUM_THREADS);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < NUM_THREADS; t++) {
+			threads.emplace_back(Worker, std::ref(T), std::ref(models[t]), t, rng());
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		std::multiset<int> model;
+		for (const std::multiset<int>& part : models) {
+			model.insert(part.begin(), part.end());
+		}
+		CheckContents(T, model);
+		// the keys all fall in one of the four initial ranges, so only
+		// median splits can leave more than one shard; the empty ones are
+		// joined away
+		T.Rebalance();
+		assert(T.ShardCount() > 1);
+		CheckContents(T, model);
+		// drain most of it, neighbours are joined back and the shards they
+		// held adopted by the survivors
+		size_t shards = T.ShardCount();
+		std::vector<int> keys(model.begin(), model.end());
+		std::shuffle(keys.begin(), keys.end(), rng);
+		keys.resize(keys.size() - keys.size() / 64);
+		std::unique_ptr<bool[]> out(new bool[keys.size()]);
+		T.DeleteMany(keys.data(), keys.size(), out.get());
+		for (size_t i = 0; i < keys.size(); i++) {
+			assert(out[i]);
+			model.erase(model.find(keys[i]));
+		}
+		T.Rebalance();
+		assert(T.ShardCount() < shards);
+		assert(T.ShardCount() == 1 || model.size() >= 512);
+		CheckContents(T, model);
+		for (int key : model) {
+			assert(T.Find(key));
+		}
+		while (!T.empty()) {
+			assert(T.DeleteMin() == *model.begin());
+			model.erase(model.begin());
+		}
+		assert(model.empty());
+		std::cout << "." << std::flush;
+	}
+	CheckChurn(rng);
+	std::cout << "Tests complete.\n";
+}
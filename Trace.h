@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Compile-time tracing for the tree hot paths. Build with -DAVL_TRACE to
+// record events into a fixed-size ring buffer that can be dumped after the
+// run; without it AVL_TRACE_EVENT and AVL_TRACE_DUMP expand to nothing and
+// none of this code is instantiated.
+//
+// The ring is shared by every thread, and the parallel set operations and
+// ShardedAVL's forked shard work record into it from several at once:
+// each Record claims its own slot with one atomic increment and stores
+// the fields as relaxed atomics, so concurrent records never race. A
+// record overwritten while a thread laps the whole ring may come out
+// mixed from two events. Dump once the recording threads are done.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+enum class TraceEvent : uint8_t {
+	Insert,
+	Delete,
+	DeleteMin,
+	RotateLeft,
+	RotateRight,
+	HeightChange
+};
+
+struct TraceRecord {
+	std::atomic<TraceEvent> event;
+	std::atomic<int> key;
+	// event specific: the new height for HeightChange, unused otherwise
+	std::atomic<int> detail;
+};
+
+// Keeps the most recent Capacity records, older ones are overwritten.
+template <size_t Capacity>
+class TraceRing {
+ public:
+	TraceRing() : count_(0) {}
+
+	void Record(TraceEvent event, int key, int detail) {
+		TraceRecord& record = records_[count_.fetch_add(1, std::memory_order_relaxed) % Capacity];
+		record.event.store(event, std::memory_order_relaxed);
+		record.key.store(key, std::memory_order_relaxed);
+		record.detail.store(detail, std::memory_order_relaxed);
+	}
+
+	void Dump(std::ostream& out) const {
+		static const char* const names[] = {
+			"Insert", "Delete", "DeleteMin", "RotateLeft", "RotateRight", "HeightChange"
+		};
+		uint64_t count = count_.load(std::memory_order_relaxed);
+		uint64_t first = (count > Capacity) ? count - Capacity : 0;
+		if (first > 0) {
+			out << "(" << first << " older events dropped)\n";
+		}
+		for (uint64_t i = first; i < count; i++) {
+			const TraceRecord& record = records_[i % Capacity];
+			TraceEvent event = record.event.load(std::memory_order_relaxed);
+			out << i << " " << names[static_cast<int>(event)]
+				<< " " << record.key.load(std::memory_order_relaxed);
+			if (event == TraceEvent::HeightChange) {
+				out << " " << record.detail.load(std::memory_order_relaxed);
+			}
+			out << "\n";
+		}
+	}
+
+ private:
+	TraceRecord records_[Capacity];
+	std::atomic<uint64_t> count_;
+}; // class TraceRing
+
+inline TraceRing<1 << 16>& AVLTrace() {
+	static TraceRing<1 << 16> ring;
+	return ring;
+}
+
+#ifdef AVL_TRACE
+#define AVL_TRACE_EVENT(event, key, detail) \
+	AVLTrace().Record(TraceEvent::event, (key), (detail))
+#define AVL_TRACE_DUMP(out) AVLTrace().Dump(out)
+#else
+#define AVL_TRACE_EVENT(event, key, detail) do {} while (0)
+#define AVL_TRACE_DUMP(out) do {} while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,91 @@
+#ifndef TREEITERATOR_H
+#define TREEITERATOR_H
+
+#include <cstddef>
+#include <iterator>
+
+// Bidirectional in-order iterator over the keys of a BST or AVL tree. It
+// steps through the parent_ links of Node, so it needs no auxiliary stack
+// and never allocates; ++ and -- are O(1) amortized. end() is a null node,
+// decrementing it climbs to the maximum of the tree whose root_ it refers
+// to. Any Insert/Delete/DeleteMin invalidates iterators.
+template <class Node>
+class TreeIterator {
+ public:
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef int value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const int* pointer;
+	typedef const int& reference;
+
+	TreeIterator() : node_(nullptr), root_(nullptr) {}
+	TreeIterator(const Node* node, Node* const* root) : node_(node), root_(root) {}
+
+	reference operator*() const { return node_->key_; }
+	pointer operator->() const { return &node_->key_; }
+
+	TreeIterator& operator++() {
+		if (node_->right_ != nullptr) {
+			node_ = Leftmost(node_->right_);
+		} else {
+			const Node* child = node_;
+			node_ = node_->parent_;
+			while (node_ != nullptr && child == node_->right_) {
+				child = node_;
+				node_ = node_->parent_;
+			}
+		}
+		return *this;
+	}
+
+	TreeIterator operator++(int) {
+		TreeIterator old(*this);
+		++*this;
+		return old;
+	}
+
+	TreeIterator& operator--() {
+		if (node_ == nullptr) {
+			node_ = Rightmost(*root_);
+		} else if (node_->left_ != nullptr) {
+			node_ = Rightmost(node_->left_);
+		} else {
+			const Node* child = node_;
+			node_ = node_->parent_;
+			while (node_ != nullptr && child == node_->left_) {
+				child = node_;
+				node_ = node_->parent_;
+			}
+		}
+		return *this;
+	}
+
+	TreeIterator operator--(int) {
+		TreeIterator old(*this);
+		--*this;
+		return old;
+	}
+
+	bool operator==(const TreeIterator& other) const { return node_ == other.node_; }
+	bool operator!=(const TreeIterator& other) const { return node_ != other.node_; }
+
+	static const Node* Leftmost(const Node* node) {
+		while (node != nullptr && node->left_ != nullptr) {
+			node = node->left_;
+		}
+		return node;
+	}
+
+	static const Node* Rightmost(const Node* node) {
+		while (node != nullptr && node->right_ != nullptr) {
+			node = node->right_;
+		}
+		return node;
+	}
+
+ private:
+	const Node* node_;
+	Node* const* root_;
+}; // class TreeIterator
+
+#endif // TREEITERATOR_H
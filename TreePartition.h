@@ -0,0 +1,141 @@
+#ifndef TREEPARTITION_H
+#define TREEPARTITION_H
+
+#include <cstddef>
+#include <vector>
+
+#include "ForkJoinPool.h"
+
+// Cuts the in-order sequence of a BST or AVL tree into pieces that can be
+// walked independently, for exporters that serialize a big tree on several
+// threads: every subtree some levels below the root is a piece, and so is
+// every single node above them. Pieces are numbered in key order, so
+// writing them out one after another gives the same output as one in-order
+// walk; nothing is allocated per node and the tree is only read.
+template <class Node>
+class TreePartition {
+ public:
+	// pieces of about kPieceNodes nodes in a balanced tree
+	static const size_t kPieceNodes = 1 << 16;
+
+	TreePartition(const Node* root, size_t size);
+
+	size_t size() const;
+	// top of piece i, which is a whole subtree or only that node
+	const Node* Top(size_t i) const;
+	bool Whole(size_t i) const;
+	// the node of piece i that comes first in key order
+	const Node* First(size_t i) const;
+	// calls visit(node) for every node of piece i in key order
+	template <class Visitor>
+	void Visit(size_t i, Visitor visit) const;
+	// runs work(i) for every piece i in [first, last) on pool, inline when
+	// the pool has no workers
+	template <class Work>
+	static void Fork(ForkJoinPool& pool, size_t first, size_t last, Work& work);
+
+ private:
+	struct Piece {
+		const Node* top;
+		bool whole;
+	};
+
+	void Cut(const Node* node, int depth);
+
+	std::vector<Piece> pieces_;
+}; // class TreePartition
+
+template <class Node>
+const size_t TreePartition<Node>::kPieceNodes;
+
+template <class Node>
+TreePartition<Node>::TreePartition(const Node* root, size_t size) {
+	int depth = 0;
+	while ((size >> depth) > kPieceNodes) {
+		depth++;
+	}
+	Cut(root, depth);
+}
+
+template <class Node>
+size_t TreePartition<Node>::size() const {
+	return pieces_.size();
+}
+
+template <class Node>
+const Node* TreePartition<Node>::Top(size_t i) const {
+	return pieces_[i].top;
+}
+
+template <class Node>
+bool TreePartition<Node>::Whole(size_t i) const {
+	return pieces_[i].whole;
+}
+
+template <class Node>
+const Node* TreePartition<Node>::First(size_t i) const {
+	const Node* node = pieces_[i].top;
+	while (pieces_[i].whole && node->left_ != nullptr) {
+		node = node->left_;
+	}
+	return node;
+}
+
+template <class Node>
+template <class Visitor>
+void TreePartition<Node>::Visit(size_t i, Visitor visit) const {
+	const Node* top = pieces_[i].top;
+	if (!pieces_[i].whole) {
+		visit(top);
+		return;
+	}
+	// in order through the parent links, without climbing above top
+	const Node* node = top;
+	while (node->left_ != nullptr) {
+		node = node->left_;
+	}
+	while (node != nullptr) {
+		visit(node);
+		if (node->right_ != nullptr) {
+			node = node->right_;
+			while (node->left_ != nullptr) {
+				node = node->left_;
+			}
+		} else {
+			const Node* child = node;
+			while (child != top && child == child->parent_->right_) {
+				child = child->parent_;
+			}
+			node = (child == top) ? nullptr : child->parent_;
+		}
+	}
+}
+
+template <class Node>
+template <class Work>
+void TreePartition<Node>::Fork(ForkJoinPool& pool, size_t first, size_t last, Work& work) {
+	if (last - first == 1) {
+		work(first);
+		return;
+	}
+	size_t middle = first + (last - first) / 2;
+	pool.Invoke(
+		[&] { Fork(pool, first, middle, work); },
+		[&] { Fork(pool, middle, last, work); });
+}
+
+template <class Node>
+void TreePartition<Node>::Cut(const Node* node, int depth) {
+	if (node == nullptr) {
+		return;
+	}
+	if (depth == 0) {
+		pieces_.push_back(Piece{node, true});
+		return;
+	}
+	Cut(node->left_, depth - 1);
+	pieces_.push_back(Piece{node, false});
+	Cut(node->right_, depth - 1);
+}
+
+#endif // TREEPARTITION_H